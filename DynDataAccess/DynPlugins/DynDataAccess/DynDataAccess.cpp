@@ -11,6 +11,14 @@
 //#define DYNDATAACCESS_DEBUG              // Comment out to remove debugging
 
 #include <DynRPG/DynRPG.h>
+#include <vector>           // Result buffers of the battle simulation
+#include <string>           // Pooled text parameters
+#include <deque>            // Storage of pooled text parameters
+#include <algorithm>        // std::sort for simulation statistics, std::swap
+#include <map>              // Lookup tables keyed by database ID
+#include <cstdio>           // Writing trace and export files
+#include <cstring>          // strcmp for comment commands and strncpy for trace event names
+#include <cctype>           // tolower for expression keywords
 #ifdef DYNDATAACCESS_DEBUG
 #include <sstream>          // Only needed for debug purposes
 #include <iostream>         // Only needed for debug purposes
@@ -30,11 +38,1724 @@
 #endif // DYNDATAACCESS_DEBUG
 // /DEBUG
 
+// TEXT INTERNING
+// Text parameters such as file names and popup text tend to be the same few strings over and
+// over. Each distinct text is stored once in a pool, and comment commands pass the pooled string
+// on to DynRPG. Looking a text up never allocates, and since the std::string of this compiler
+// shares its buffer between copies, handing a pooled string to a DynRPG function which takes a
+// std::string by value does not allocate either.
+
+std::deque<std::string> internedStrings;    //!< Every distinct text seen so far; a deque, so pooled strings never move
+std::vector<int> internTable(64, -1);       //!< Open addressing hash table of indices into internedStrings, -1 for empty slots
+
+//! FNV-1a hash of a null-terminated string
+unsigned int internHash(const char* text)
+{
+    unsigned int hash = 2166136261u;
+    for(; *text != '\0'; text++)
+        hash = (hash ^ (unsigned char) *text) * 16777619u;
+    return hash;
+}
+
+//! Get the pooled copy of a text, adding it to the pool the first time it is seen
+const std::string& internText(const char* text)
+{
+    unsigned int mask = internTable.size() - 1;
+    unsigned int slot = internHash(text) & mask;
+    while(internTable[slot] >= 0)
+    {
+        if(0 == strcmp(internedStrings[internTable[slot]].c_str(), text))
+            return internedStrings[internTable[slot]];
+        slot = (slot + 1) & mask;
+    }
+    internedStrings.push_back(text);
+    internTable[slot] = internedStrings.size() - 1;
+    if(internedStrings.size() * 2 > internTable.size())
+    {   // Keep the table at most half full so lookups stay short
+        internTable.assign(internTable.size() * 2, -1);
+        mask = internTable.size() - 1;
+        for(size_t i=0; i<internedStrings.size(); i++) {
+            slot = internHash(internedStrings[i].c_str()) & mask;
+            while(internTable[slot] >= 0)
+                slot = (slot + 1) & mask;
+            internTable[slot] = i; }
+    }
+    return internedStrings.back();
+}
+
+// BATTLE SIMULATION
+// Headless Monte Carlo simulation of a database troop against the current party, used to check
+// the raw stat balance of database enemies against the party without fighting every test battle
+// by hand. Only HP, attack, defense and agility take part, so skill, attribute and resistance
+// settings do not change the results. Everything the simulation needs is copied out of DynRPG
+// before any worker thread starts, since the game's own objects must only ever be touched from
+// the main thread.
+
+const int SIM_MAX_TURNS = 100;              //!< Turn limit after which a simulated battle counts as lost
+const int SIM_CHUNK_SIZE = 32;              //!< Number of battles a worker thread claims at a time
+const int SIM_MAX_BATTLES = 100000;         //!< Most battles one simulation run may contain
+const int SIM_RESULT_COUNT = 17;            //!< Number of sequential variables written by a simulation
+
+//! Battle-relevant stats of one simulated combatant
+struct SimBattler
+{
+    int hp;                                 //!< HP at the start of a battle
+    int attack;
+    int defense;
+    int agility;
+};
+
+//! Outcome of one simulated battle
+struct SimResult
+{
+    bool won;
+    int turns;
+    int damageDealt;                        //!< Total damage dealt by the party
+    int damageTaken;                        //!< Total damage taken by the party
+};
+
+//! Shared state of one simulation run
+struct SimJob
+{
+    SimBattler party[4];
+    int partySize;
+    SimBattler troop[8];
+    int troopSize;
+    unsigned int seed;
+    int battleCount;
+    volatile LONG nextBattle;               //!< Index of the next battle not yet claimed by a worker
+    std::vector<SimResult> results;
+};
+
+//! Derive the random state of one battle from the run seed and the battle index
+/*!
+    Every battle gets its own random sequence, so results do not depend on how many threads ran the
+    simulation or which thread picked up which battle.
+*/
+unsigned int simBattleSeed(unsigned int seed, unsigned int battleIndex)
+{
+    unsigned int state = seed ^ (battleIndex * 0x9E3779B9u);
+    state ^= state >> 16;
+    state *= 0x85EBCA6Bu;
+    state ^= state >> 13;
+    state *= 0xC2B2AE35u;
+    state ^= state >> 16;
+    return state ? state : 0x6D2B79F5u;    // Xorshift must never be seeded with zero
+}
+
+//! Advance a xorshift random state and return a number from 0 to range-1
+int simRandom(unsigned int& state, int range)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (int) (state % (unsigned int) range);
+}
+
+//! Damage of a normal attack, following RM2K3's Attack/2 - Defense/4 formula with 20% variance
+int simDamage(const SimBattler& attacker, const SimBattler& target, unsigned int& state)
+{
+    int damage = attacker.attack / 2 - target.defense / 4;
+    if(damage <= 0)
+        return 0;
+    int variance = damage / 5;
+    if(variance > 0)
+        damage += simRandom(state, variance * 2 + 1) - variance;
+    return damage;
+}
+
+//! Count the living battlers of one side
+int simLivingCount(const int* hp, int count)
+{
+    int living = 0;
+    for(int i=0; i<count; i++) {
+        if(hp[i] > 0)
+            living++; }
+    return living;
+}
+
+//! Pick a random living battler out of a side, or -1 if the whole side has fallen
+int simPickTarget(const int* hp, int count, unsigned int& state)
+{
+    int living = simLivingCount(hp, count);
+    if(living == 0)
+        return -1;
+    int pick = simRandom(state, living);
+    for(int i=0; i<count; i++) {
+        if(hp[i] > 0 && pick-- == 0)
+            return i; }
+    return -1;
+}
+
+//! Fight out one battle of a simulation run
+/*!
+    Each turn every living combatant acts once, in order of agility plus a random initiative roll,
+    and attacks a random living opponent. Skills, items, attributes, resistances, conditions and AI
+    patterns are not modelled; the simulation measures raw stat balance only.
+
+    \param job (const SimJob&) The simulation run the battle belongs to
+    \param battleIndex (int) The index of the battle within the run
+    \param result (SimResult&) Receives the outcome of the battle
+*/
+void simulateBattle(const SimJob& job, int battleIndex, SimResult& result)
+{
+    unsigned int state = simBattleSeed(job.seed, (unsigned int) battleIndex);
+    int partyHp[4];
+    int troopHp[8];
+    int order[12];                          // Acting combatants; party members 0-3, enemies 4-11
+    int initiative[12];
+    for(int i=0; i<job.partySize; i++)
+        partyHp[i] = job.party[i].hp;
+    for(int i=0; i<job.troopSize; i++)
+        troopHp[i] = job.troop[i].hp;
+    result.won = false;
+    result.damageDealt = 0;
+    result.damageTaken = 0;
+    for(result.turns=1; result.turns<=SIM_MAX_TURNS; result.turns++)
+    {
+        // Roll initiative for every living combatant and sort them into acting order
+        int actors = 0;
+        for(int i=0; i<job.partySize+job.troopSize; i++)
+        {
+            const SimBattler& battler = (i < job.partySize) ? job.party[i] : job.troop[i-job.partySize];
+            int hp = (i < job.partySize) ? partyHp[i] : troopHp[i-job.partySize];
+            if(hp <= 0)
+                continue;
+            int roll = battler.agility + simRandom(state, battler.agility / 4 + 1);
+            int slot = actors++;
+            while(slot > 0 && initiative[slot-1] < roll) {
+                order[slot] = order[slot-1];
+                initiative[slot] = initiative[slot-1];
+                slot--; }
+            order[slot] = (i < job.partySize) ? i : 4 + i - job.partySize;
+            initiative[slot] = roll;
+        }
+        // Let everybody still standing take their action
+        for(int i=0; i<actors; i++)
+        {
+            if(order[i] < 4)
+            {
+                if(partyHp[order[i]] <= 0)
+                    continue;
+                int target = simPickTarget(troopHp, job.troopSize, state);
+                if(target < 0)
+                    break;
+                int damage = simDamage(job.party[order[i]], job.troop[target], state);
+                if(damage > troopHp[target])
+                    damage = troopHp[target];
+                troopHp[target] -= damage;
+                result.damageDealt += damage;
+            }
+            else
+            {
+                if(troopHp[order[i]-4] <= 0)
+                    continue;
+                int target = simPickTarget(partyHp, job.partySize, state);
+                if(target < 0)
+                    break;
+                int damage = simDamage(job.troop[order[i]-4], job.party[target], state);
+                if(damage > partyHp[target])
+                    damage = partyHp[target];
+                partyHp[target] -= damage;
+                result.damageTaken += damage;
+            }
+        }
+        if(simLivingCount(troopHp, job.troopSize) == 0) {
+            result.won = true;
+            return; }
+        if(simLivingCount(partyHp, job.partySize) == 0)
+            return;
+    }
+    result.turns = SIM_MAX_TURNS;
+}
+
+//! Worker thread body; claims chunks of battles until the whole run is done
+DWORD WINAPI simWorker(LPVOID parameter)
+{
+    SimJob* job = (SimJob*) parameter;
+    for(;;)
+    {
+        int first = (int) InterlockedExchangeAdd(&job->nextBattle, SIM_CHUNK_SIZE);
+        if(first >= job->battleCount)
+            break;
+        int last = first + SIM_CHUNK_SIZE;
+        if(last > job->battleCount)
+            last = job->battleCount;
+        for(int i=first; i<last; i++)
+            simulateBattle(*job, i, job->results[i]);
+    }
+    return 0;
+}
+
+//! Store the mean, minimum, median, 90th percentile and maximum of a set of per-battle values
+/*!
+    \param variableIndex (int) The index of the first of five RM2K3 variables to store data in
+    \param values (std::vector<int>&) The values, one per battle; sorted in place
+    \param count (int) The number of values to use, at least one
+*/
+void storeSimDistribution(int variableIndex, std::vector<int>& values, int count)
+{
+    std::sort(values.begin(), values.begin() + count);
+    long long total = 0;
+    for(int i=0; i<count; i++)
+        total += values[i];
+    RPG::variables[variableIndex] = (int) ((total + count / 2) / count);
+    RPG::variables[variableIndex+1] = values[0];
+    RPG::variables[variableIndex+2] = values[count / 2];
+    RPG::variables[variableIndex+3] = values[(count - 1) * 9 / 10];
+    RPG::variables[variableIndex+4] = values[count - 1];
+}
+
+//! Simulate battles of a database troop against the current party and store the statistics
+/*!
+    The battles are spread over one thread per processor core, but the call only returns once all
+    of them are done, so the game is paused while it runs. Party members fight with their current
+    HP and those who are down do not take part. Results are stored in SIM_RESULT_COUNT sequential
+    variables: battles won, win rate (in tenths of a percent), then the mean, minimum, median,
+    90th percentile and maximum of the turns taken by won battles, of the damage dealt by the party
+    per battle and of the damage taken by the party per battle. The turn statistics are 0 if no
+    battle was won. All variables are set to 0 if the troop does not exist or nobody can fight.
+
+    \param variableIndex (int) The index of the first RM2K3 variable to store data in
+    \param troopId (int) The database ID of the troop (monster group)
+    \param battleCount (int) The number of battles to simulate, at most SIM_MAX_BATTLES
+    \param seed (unsigned int) The random seed; the same seed always gives the same results
+*/
+void runBattleSimulation(int variableIndex, int troopId, int battleCount, unsigned int seed)
+{
+    static SimJob job;                      // Kept between runs so its result buffer is reused
+    for(int i=0; i<SIM_RESULT_COUNT; i++)
+        RPG::variables[variableIndex+i] = 0;
+    if(troopId < 1 || troopId > RPG::dbMonsterGroups.count() || battleCount <= 0)
+        return;
+    if(battleCount > SIM_MAX_BATTLES)
+        battleCount = SIM_MAX_BATTLES;
+    job.partySize = 0;
+    for(int i=0; i<4; i++)
+    {
+        RPG::Actor* actor = RPG::Actor::partyMember(i);
+        if(actor == NULL || actor->hp <= 0)
+            continue;
+        job.party[job.partySize].hp = actor->hp;
+        job.party[job.partySize].attack = actor->getAttack();
+        job.party[job.partySize].defense = actor->getDefense();
+        job.party[job.partySize].agility = actor->getAgility();
+        job.partySize++;
+    }
+    job.troopSize = 0;
+    for(int i=0; i<RPG::dbMonsterGroups[troopId]->monsterList.count() && job.troopSize<8; i++)
+    {
+        int monsterId = RPG::dbMonsterGroups[troopId]->monsterList[i]->databaseId;
+        if(monsterId < 1 || monsterId > RPG::dbMonsters.count())
+            continue;
+        RPG::DBMonster* monster = RPG::dbMonsters[monsterId];
+        job.troop[job.troopSize].hp = monster->maxHp;
+        job.troop[job.troopSize].attack = monster->attack;
+        job.troop[job.troopSize].defense = monster->defense;
+        job.troop[job.troopSize].agility = monster->agility;
+        job.troopSize++;
+    }
+    if(job.partySize == 0 || job.troopSize == 0)
+        return;
+    job.seed = seed;
+    job.battleCount = battleCount;
+    job.nextBattle = 0;
+    job.results.resize(battleCount);
+
+    // Start one worker per additional core; the main thread works through battles as well
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    int threadCount = (int) systemInfo.dwNumberOfProcessors - 1;
+    if(threadCount > MAXIMUM_WAIT_OBJECTS)
+        threadCount = MAXIMUM_WAIT_OBJECTS;
+    if(threadCount > battleCount / SIM_CHUNK_SIZE)
+        threadCount = battleCount / SIM_CHUNK_SIZE;
+    HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+    int started = 0;
+    for(int i=0; i<threadCount; i++) {
+        threads[started] = CreateThread(NULL, 0, simWorker, &job, 0, NULL);
+        if(threads[started] != NULL)
+            started++; }
+    simWorker(&job);
+    if(started > 0)
+        WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+    for(int i=0; i<started; i++)
+        CloseHandle(threads[i]);
+
+    // Reduce the results in battle order so the totals never depend on thread scheduling
+    static std::vector<int> turns, dealt, taken;
+    turns.resize(battleCount);
+    dealt.resize(battleCount);
+    taken.resize(battleCount);
+    int wins = 0;
+    for(int i=0; i<battleCount; i++) {
+        if(job.results[i].won)
+            turns[wins++] = job.results[i].turns;
+        dealt[i] = job.results[i].damageDealt;
+        taken[i] = job.results[i].damageTaken; }
+    RPG::variables[variableIndex] = wins;
+    RPG::variables[variableIndex+1] = (int) ((long long) wins * 1000 / battleCount);
+    if(wins > 0)
+        storeSimDistribution(variableIndex+2, turns, wins);
+    storeSimDistribution(variableIndex+7, dealt, battleCount);
+    storeSimDistribution(variableIndex+12, taken, battleCount);
+}
+
+// EXPRESSION EVALUATOR
+// Compiles the arithmetic expressions of @dyndataaccess_eval into a small stack bytecode the first
+// time a comment line runs, and keeps the result keyed by the line's location so later runs only
+// evaluate. Expressions are made of integers, + - * / %, parentheses, min(a, b), max(a, b),
+// var[n] (an RM2K3 variable) and battler fields such as enemy[2].defense or party[1].attack.
+
+const int EVAL_MAX_STACK = 64;              //!< Deepest evaluation stack an expression may need
+const int EVAL_MAX_NESTING = 64;            //!< Deepest recursion of the compiler; each parenthesis, bracket or unary minus costs one or two levels
+
+//! Bytecode operations; PUSH, ENEMY_FIELD and PARTY_FIELD are followed by one operand
+enum EvalOp
+{
+    EVAL_PUSH,                              //!< Push the operand
+    EVAL_VARIABLE,                          //!< Pop a variable index, push the variable
+    EVAL_ENEMY_FIELD,                       //!< Pop an enemy number (and index for array fields), push the field given by the operand
+    EVAL_PARTY_FIELD,                       //!< Pop a party member number (and index for array fields), push the field given by the operand
+    EVAL_ADD, EVAL_SUBTRACT, EVAL_MULTIPLY, EVAL_DIVIDE, EVAL_MODULO,
+    EVAL_NEGATE, EVAL_MIN, EVAL_MAX
+};
+
+//! Battler fields an expression can read; fields from EVAL_FIELD_CONDITION on take an index
+enum EvalField
+{
+    EVAL_FIELD_ID, EVAL_FIELD_HP, EVAL_FIELD_MP, EVAL_FIELD_MAX_HP, EVAL_FIELD_MAX_MP,
+    EVAL_FIELD_ATTACK, EVAL_FIELD_DEFENSE, EVAL_FIELD_INTELLIGENCE, EVAL_FIELD_AGILITY, EVAL_FIELD_ATB,
+    EVAL_FIELD_CONDITION,                   //!< Turns afflicted with condition [n]
+    EVAL_FIELD_ATTRIBUTE                    //!< Database resistance percentage for attribute [n]
+};
+
+//! Names of the EvalField values as written in expressions, in the same order
+const char* const EVAL_FIELD_NAMES[] = {
+    "id", "hp", "mp", "maxhp", "maxmp", "attack", "defense", "intelligence", "agility", "atb",
+    "condition", "attribute", NULL };
+
+//! A compiled expression and the text it was compiled from
+struct EvalProgram
+{
+    std::string source;                     //!< Used to notice when a different comment lands on the same call site
+    std::vector<int> code;
+    bool valid;
+};
+
+//! Location of a comment line, used as the key of the compiled expression cache
+struct EvalCallSite
+{
+    int eventId;
+    int pageId;
+    int lineId;
+    bool operator<(const EvalCallSite& other) const
+    {
+        if(eventId != other.eventId)
+            return eventId < other.eventId;
+        if(pageId != other.pageId)
+            return pageId < other.pageId;
+        return lineId < other.lineId;
+    }
+};
+
+std::map<EvalCallSite, EvalProgram> evalPrograms; //!< Compiled expressions by comment line
+
+//! Recursive descent compiler from expression text to EvalOp bytecode
+class EvalCompiler
+{
+public:
+    EvalCompiler(const char* source, std::vector<int>& code) : pos(source), code(code), depth(0), nesting(0), failed(false) {}
+
+    //! Compile the whole source; returns false and sets error if it is not a valid expression
+    bool compile()
+    {
+        code.clear();
+        expression();
+        skipSpaces();
+        if(!failed && *pos != '\0')
+            fail("unexpected text");
+        return !failed;
+    }
+
+    std::string error;                      //!< Description of the first error found
+
+private:
+    const char* pos;                        // Next character to read
+    std::vector<int>& code;
+    int depth;                              // Stack depth the code compiled so far leaves behind
+    int nesting;                            // Recursion depth of the compiler itself
+    bool failed;
+
+    void fail(const char* message)
+    {
+        if(failed)
+            return;
+        failed = true;
+        error = std::string(message) + " at \"" + pos + "\"";
+    }
+    void skipSpaces()
+    {
+        while(*pos == ' ' || *pos == '\t')
+            pos++;
+    }
+    bool accept(char c)
+    {
+        skipSpaces();
+        if(*pos != c)
+            return false;
+        pos++;
+        return true;
+    }
+    void expect(char c)
+    {
+        if(!accept(c)) {
+            char message[] = "expected ' '";
+            message[10] = c;
+            fail(message); }
+    }
+    std::string identifier()
+    {
+        skipSpaces();
+        const char* start = pos;
+        while((*pos >= 'a' && *pos <= 'z') || (*pos >= 'A' && *pos <= 'Z') || *pos == '_')
+            pos++;
+        std::string name(start, pos);
+        for(size_t i=0; i<name.size(); i++)
+            name[i] = (char) tolower(name[i]);
+        return name;
+    }
+    void emit(int op, int stackChange)
+    {
+        code.push_back(op);
+        depth += stackChange;
+        if(depth > EVAL_MAX_STACK)
+            fail("expression too complex");
+    }
+    void emitPush(int value)
+    {
+        emit(EVAL_PUSH, 1);
+        code.push_back(value);
+    }
+
+    //! Enter one level of recursion; returns false (after failing) if the expression nests too deeply
+    bool enter()
+    {
+        if(++nesting <= EVAL_MAX_NESTING)
+            return true;
+        fail("expression nested too deeply");
+        return false;
+    }
+
+    void expression()
+    {
+        if(!enter())
+            return;
+        term();
+        for(;;)
+        {
+            if(accept('+')) { term(); emit(EVAL_ADD, -1); }
+            else if(accept('-')) { term(); emit(EVAL_SUBTRACT, -1); }
+            else break;
+        }
+        nesting--;
+    }
+    void term()
+    {
+        unary();
+        for(;;)
+        {
+            if(accept('*')) { unary(); emit(EVAL_MULTIPLY, -1); }
+            else if(accept('/')) { unary(); emit(EVAL_DIVIDE, -1); }
+            else if(accept('%')) { unary(); emit(EVAL_MODULO, -1); }
+            else return;
+        }
+    }
+    void unary()
+    {
+        if(!enter())
+            return;
+        if(accept('-')) {
+            unary();
+            emit(EVAL_NEGATE, 0); }
+        else
+            primary();
+        nesting--;
+    }
+    void primary()
+    {
+        if(failed)
+            return;
+        skipSpaces();
+        if(*pos >= '0' && *pos <= '9') {
+            int value = 0;
+            while(*pos >= '0' && *pos <= '9') {
+                int digit = *pos++ - '0';
+                if(value > (2147483647 - digit) / 10) {
+                    fail("number too large");
+                    return; }
+                value = value * 10 + digit; }
+            emitPush(value);
+            return; }
+        if(accept('(')) {
+            expression();
+            expect(')');
+            return; }
+        std::string name = identifier();
+        if(name == "min" || name == "max") {
+            expect('(');
+            expression();
+            expect(',');
+            expression();
+            expect(')');
+            emit(name == "min" ? EVAL_MIN : EVAL_MAX, -1);
+            return; }
+        if(name == "var") {
+            expect('[');
+            expression();
+            expect(']');
+            emit(EVAL_VARIABLE, 0);
+            return; }
+        if(name == "enemy" || name == "party") {
+            expect('[');
+            expression();
+            expect(']');
+            expect('.');
+            std::string fieldName = identifier();
+            int field = 0;
+            while(EVAL_FIELD_NAMES[field] != NULL && fieldName != EVAL_FIELD_NAMES[field])
+                field++;
+            if(EVAL_FIELD_NAMES[field] == NULL) {
+                fail("unknown field");
+                return; }
+            if(field >= EVAL_FIELD_CONDITION) {
+                expect('[');
+                expression();
+                expect(']');
+                depth--; }
+            emit(name == "enemy" ? EVAL_ENEMY_FIELD : EVAL_PARTY_FIELD, 0);
+            code.push_back(field);
+            return; }
+        fail("expected a number, variable or battler field");
+    }
+};
+
+//! Database resistance percentage of a battler for an attribute, given the A-E rank (0-4) it has in the database
+int attributeRankPercent(int attributeId, int rank)
+{
+    switch(rank)
+    {
+        case 0: return RPG::attributes[attributeId]->dmgA;
+        case 1: return RPG::attributes[attributeId]->dmgB;
+        case 2: return RPG::attributes[attributeId]->dmgC;
+        case 3: return RPG::attributes[attributeId]->dmgD;
+        case 4: return RPG::attributes[attributeId]->dmgE;
+    }
+    return 0;
+}
+
+//! Read a battler field for an expression; nonexistent battlers, conditions and attributes read as 0
+int evalBattlerField(bool enemy, int number, int field, int index)
+{
+    if(field == EVAL_FIELD_CONDITION && (index < 1 || index > RPG::conditions.count()))
+        return 0;
+    if(field == EVAL_FIELD_ATTRIBUTE && (index < 1 || index > RPG::attributes.count()))
+        return 0;
+    RPG::Battler* battler;
+    if(enemy)
+        battler = (number >= 1 && number <= 8) ? RPG::monsters[number-1] : NULL;
+    else
+        battler = (number >= 1 && number <= 4) ? RPG::Actor::partyMember(number-1) : NULL;
+    if(battler == NULL)
+        return 0;
+    switch(field)
+    {
+        case EVAL_FIELD_ID: return enemy ? ((RPG::Monster*) battler)->databaseId : battler->id;
+        case EVAL_FIELD_HP: return battler->hp;
+        case EVAL_FIELD_MP: return battler->mp;
+        case EVAL_FIELD_MAX_HP: return battler->getMaxHp();
+        case EVAL_FIELD_MAX_MP: return battler->getMaxMp();
+        case EVAL_FIELD_ATTACK: return battler->getAttack();
+        case EVAL_FIELD_DEFENSE: return battler->getDefense();
+        case EVAL_FIELD_INTELLIGENCE: return battler->getIntelligence();
+        case EVAL_FIELD_AGILITY: return battler->getAgility();
+        case EVAL_FIELD_ATB: return battler->atbValue;
+        case EVAL_FIELD_CONDITION: return battler->conditions[index];
+        case EVAL_FIELD_ATTRIBUTE:
+            if(enemy)
+                return attributeRankPercent(index, RPG::dbMonsters[((RPG::Monster*) battler)->databaseId]->attributes[index]);
+            return attributeRankPercent(index, RPG::dbActors[battler->id]->attributes[index]);
+    }
+    return 0;
+}
+
+//! Run compiled expression bytecode and return its value; division by zero gives 0
+/*!
+    Addition, subtraction, multiplication and negation are done on unsigned values, so results out
+    of int range wrap around instead of being undefined. Division by -1 is done as a negation, since
+    dividing the lowest int by -1 faults on x86.
+*/
+int evalRun(const std::vector<int>& code)
+{
+    int stack[EVAL_MAX_STACK];
+    int top = -1;
+    for(size_t i=0; i<code.size(); i++)
+    {
+        switch(code[i])
+        {
+            case EVAL_PUSH:
+                stack[++top] = code[++i];
+                break;
+            case EVAL_VARIABLE:
+                stack[top] = RPG::variables[stack[top]];
+                break;
+            case EVAL_ENEMY_FIELD:
+            case EVAL_PARTY_FIELD:
+            {
+                int field = code[++i];
+                int index = 0;
+                if(field >= EVAL_FIELD_CONDITION)
+                    index = stack[top--];
+                stack[top] = evalBattlerField(code[i-1] == EVAL_ENEMY_FIELD, stack[top], field, index);
+                break;
+            }
+            case EVAL_ADD: top--; stack[top] = (int) ((unsigned int) stack[top] + (unsigned int) stack[top+1]); break;
+            case EVAL_SUBTRACT: top--; stack[top] = (int) ((unsigned int) stack[top] - (unsigned int) stack[top+1]); break;
+            case EVAL_MULTIPLY: top--; stack[top] = (int) ((unsigned int) stack[top] * (unsigned int) stack[top+1]); break;
+            case EVAL_DIVIDE:
+                top--;
+                if(stack[top+1] == -1)
+                    stack[top] = (int) (0u - (unsigned int) stack[top]);
+                else
+                    stack[top] = stack[top+1] ? stack[top] / stack[top+1] : 0;
+                break;
+            case EVAL_MODULO:
+                top--;
+                stack[top] = (stack[top+1] && stack[top+1] != -1) ? stack[top] % stack[top+1] : 0;
+                break;
+            case EVAL_NEGATE: stack[top] = (int) (0u - (unsigned int) stack[top]); break;
+            case EVAL_MIN: top--; if(stack[top+1] < stack[top]) stack[top] = stack[top+1]; break;
+            case EVAL_MAX: top--; if(stack[top+1] > stack[top]) stack[top] = stack[top+1]; break;
+        }
+    }
+    return top >= 0 ? stack[top] : 0;
+}
+
+//! Find or compile the program for a comment line; returns NULL (after reporting the error) if the expression is invalid
+const EvalProgram* evalProgramFor(const char* source, int eventId, int pageId, int lineId)
+{
+    EvalCallSite site = { eventId, pageId, lineId };
+    EvalProgram& program = evalPrograms[site];
+    if(program.source.empty() || program.source != source)
+    {
+        program.source = source;
+        EvalCompiler compiler(source, program.code);
+        program.valid = compiler.compile();
+        if(!program.valid)
+            RPG::showError("DynDataAccess: invalid expression: " + compiler.error, eventId, pageId, lineId, false);
+    }
+    return program.valid ? &program : NULL;
+}
+
+// TROOP PROFILE
+// Troop-level data derived from the database once per battle instead of on every query. The
+// profile is rebuilt when a new battle starts or when an enemy transforms into a different
+// database monster, and dropped when the battle scene ends.
+
+const int TROOP_SLOTS = 8;                  //!< Maximum number of enemies in a battle
+const int TROOP_WEAK_RANK = 1;              //!< Highest attribute rank (0-4 for A-E) which counts as a weakness
+
+//! Database stats of the enemy in one troop slot
+struct TroopSlot
+{
+    int databaseId;                         //!< 0 if the slot is empty
+    int maxHp;
+    int maxMp;
+    int attack;
+    int defense;
+    int intelligence;
+    int agility;
+};
+
+//! Derived data about the troop in the current battle
+struct TroopProfile
+{
+    bool valid;
+    int monsterGroupId;
+    int initialSize;
+    int totalMaxHp;
+    int highestMaxHp;
+    int totalMaxMp;
+    int highestMaxMp;
+    TroopSlot slots[TROOP_SLOTS];
+    std::vector<bool> anyWeak;              //!< By attribute ID: at least one enemy is weak to it
+    std::vector<bool> allWeak;              //!< By attribute ID: every enemy is weak to it
+};
+
+TroopProfile troopProfile;                  //!< Profile of the current battle's troop; valid only during battle
+
+//! Rebuild the troop profile from the database monsters currently in battle
+void buildTroopProfile()
+{
+    troopProfile.monsterGroupId = RPG::battleData->monsterGroupId;
+    troopProfile.initialSize = RPG::dbMonsterGroups[troopProfile.monsterGroupId]->monsterList.count();
+    troopProfile.totalMaxHp = troopProfile.highestMaxHp = 0;
+    troopProfile.totalMaxMp = troopProfile.highestMaxMp = 0;
+    int attributeCount = RPG::attributes.count();
+    troopProfile.anyWeak.assign(attributeCount + 1, false); // Attribute array is one based
+    troopProfile.allWeak.assign(attributeCount + 1, true);
+    bool anyEnemy = false;
+    for(int i=0; i<TROOP_SLOTS; i++)
+    {
+        TroopSlot& slot = troopProfile.slots[i];
+        if(RPG::monsters[i] == NULL) {
+            slot.databaseId = 0;
+            slot.maxHp = slot.maxMp = slot.attack = slot.defense = slot.intelligence = slot.agility = 0;
+            continue; }
+        RPG::DBMonster* monster = RPG::dbMonsters[RPG::monsters[i]->databaseId];
+        slot.databaseId = RPG::monsters[i]->databaseId;
+        slot.maxHp = monster->maxHp;
+        slot.maxMp = monster->maxMp;
+        slot.attack = monster->attack;
+        slot.defense = monster->defense;
+        slot.intelligence = monster->intelligence;
+        slot.agility = monster->agility;
+        troopProfile.totalMaxHp += slot.maxHp;
+        troopProfile.totalMaxMp += slot.maxMp;
+        if(slot.maxHp > troopProfile.highestMaxHp)
+            troopProfile.highestMaxHp = slot.maxHp;
+        if(slot.maxMp > troopProfile.highestMaxMp)
+            troopProfile.highestMaxMp = slot.maxMp;
+        for(int a=1; a<=attributeCount; a++) {
+            bool weak = monster->attributes[a] <= TROOP_WEAK_RANK;
+            troopProfile.anyWeak[a] = troopProfile.anyWeak[a] || weak;
+            troopProfile.allWeak[a] = troopProfile.allWeak[a] && weak; }
+        anyEnemy = true;
+    }
+    if(!anyEnemy)
+        troopProfile.allWeak.assign(attributeCount + 1, false);
+    troopProfile.valid = true;
+}
+
+//! Make sure the troop profile matches the current battle, rebuilding it only if it does not
+void updateTroopProfile()
+{
+    bool current = troopProfile.valid && troopProfile.monsterGroupId == RPG::battleData->monsterGroupId;
+    for(int i=0; current && i<TROOP_SLOTS; i++) {
+        int databaseId = (RPG::monsters[i] != NULL) ? RPG::monsters[i]->databaseId : 0;
+        current = (databaseId == troopProfile.slots[i].databaseId); }
+    if(!current)
+        buildTroopProfile();
+}
+
+// BATTLE EFFECT QUEUE
+// Popups and flashes scheduled a number of frames ahead, so a multi-hit or multi-target sequence
+// can be set up by a single comment command and then plays out frame-exact without Wait commands.
+// The queue is a fixed array, kept packed in scheduling order and drained from onFrame; nothing is
+// allocated once the game runs.
+
+const int EFFECT_QUEUE_SIZE = 256;          //!< Maximum number of scheduled effects; further effects are dropped
+
+//! Kinds of scheduled battle effects
+enum EffectType
+{
+    EFFECT_NUMBER_POPUP,
+    EFFECT_TEXT_POPUP,
+    EFFECT_FLASH
+};
+
+//! One scheduled effect, shown on every enemy in its target set
+struct ScheduledEffect
+{
+    int dueFrame;                           //!< Value of effectFrame at which the effect is shown
+    EffectType type;
+    int targets;                            //!< Bit n-1 set for enemy n
+    int values[5];                          //!< Number and color for popups; red, green, blue, intensity and frames for flashes
+    const std::string* text;                //!< Pooled popup text (see internText)
+};
+
+ScheduledEffect effectQueue[EFFECT_QUEUE_SIZE]; //!< Scheduled effects, oldest first
+int effectQueueCount = 0;                   //!< Number of scheduled effects
+int effectFrame = 0;                        //!< Battle frames counted so far
+
+//! Schedule an effect repeatedly, starting after a delay and spaced by an interval (both in frames)
+/*!
+    \param effect (const ScheduledEffect&) The effect to schedule; its dueFrame is ignored
+    \param delay (int) Frames until the first repetition
+    \param repeats (int) Number of repetitions
+    \param interval (int) Frames between repetitions
+*/
+void scheduleEffect(const ScheduledEffect& effect, int delay, int repeats, int interval)
+{
+    for(int i=0; i<repeats && effectQueueCount<EFFECT_QUEUE_SIZE; i++)
+    {
+        ScheduledEffect& entry = effectQueue[effectQueueCount];
+        entry = effect;
+        entry.dueFrame = effectFrame + delay + i * interval;
+        effectQueueCount++;
+    }
+}
+
+//! Show one effect on every existing enemy in its target set
+void showEffect(const ScheduledEffect& effect)
+{
+    for(int i=0; i<TROOP_SLOTS; i++)
+    {
+        if(!(effect.targets & (1 << i)) || RPG::monsters[i] == NULL)
+            continue;
+        if(effect.type == EFFECT_NUMBER_POPUP)
+            RPG::monsters[i]->damagePopup(effect.values[0], effect.values[1]);
+        else if(effect.type == EFFECT_TEXT_POPUP)
+            RPG::monsters[i]->damagePopup(*effect.text);
+        else
+            RPG::monsters[i]->flash(effect.values[0], effect.values[1], effect.values[2], effect.values[3], effect.values[4]);
+    }
+}
+
+//! Advance the battle frame counter and show every effect which has come due
+/*!
+    Effects which are not due yet are moved up to the front of the array, keeping their order, so
+    the queue never has gaps.
+*/
+void drainEffectQueue()
+{
+    effectFrame++;
+    int kept = 0;
+    for(int i=0; i<effectQueueCount; i++)
+    {
+        ScheduledEffect& effect = effectQueue[i];
+        if(effect.dueFrame <= effectFrame)
+            showEffect(effect);
+        else {
+            if(kept != i)
+                effectQueue[kept] = effect;
+            kept++; }
+    }
+    effectQueueCount = kept;
+}
+
+//! Read an optional number parameter of a comment command
+int optionalParameter(const RPG::ParsedCommentData* parsedData, int index, int defaultValue)
+{
+    if(index < parsedData->parametersCount && parsedData->parameters[index].type == RPG::PARAM_NUMBER)
+        return (int) parsedData->parameters[index].number;
+    return defaultValue;
+}
+
+// DATABASE EXPORT
+// Writes the runtime values of several database tables, including any changes made by set
+// commands, to a binary file in one pass. Each table is stored column by column (struct of
+// arrays) so analysis tools can read a whole column at once; tools/export_reader.cpp reads the
+// format. All values are 32-bit little-endian integers:
+//
+//   "DDAX", version, table count
+//   per table: name length, name, row count, column count,
+//              per column: name length, name
+//              per column: row count values (row n holds database ID n+1)
+
+const int EXPORT_VERSION = 1;               //!< Version number written to the export file header
+
+//! One database table being exported; values are stored column after column
+struct ExportTable
+{
+    std::string name;
+    int rows;
+    std::vector<std::string> columnNames;
+    std::vector<int> values;
+};
+
+//! Append a column to a table and return where its values go; the pointer is only valid until the next column is added
+int* exportColumn(ExportTable& table, const std::string& name)
+{
+    table.columnNames.push_back(name);
+    table.values.resize(table.values.size() + table.rows);
+    return table.rows ? &table.values[table.values.size() - table.rows] : NULL;
+}
+
+//! Append one column per attribute or condition, holding each row's A-E rank (0-4)
+void exportRankColumns(ExportTable& table, const char* prefix, int count, bool actors, bool attributes)
+{
+    char name[32];
+    for(int a=1; a<=count; a++)
+    {
+        sprintf(name, "%s%d", prefix, a);
+        int* column = exportColumn(table, name);
+        for(int i=0; i<table.rows; i++)
+        {
+            if(actors)
+                column[i] = attributes ? RPG::dbActors[i+1]->attributes[a] : RPG::dbActors[i+1]->conditions[a];
+            else
+                column[i] = attributes ? RPG::dbMonsters[i+1]->attributes[a] : RPG::dbMonsters[i+1]->conditions[a];
+        }
+    }
+}
+
+//! Gather the exported tables from DynRPG
+void exportGatherTables(std::vector<ExportTable>& tables)
+{
+    int attributeCount = RPG::attributes.count();
+    int conditionCount = RPG::conditions.count();
+    int* column;
+    tables.resize(6);
+
+    ExportTable& skills = tables[0];
+    skills.name = "skills";
+    skills.rows = RPG::skills.count();
+    column = exportColumn(skills, "mpCost");
+    for(int i=0; i<skills.rows; i++) column[i] = RPG::skills[i+1]->mpCost;
+    column = exportColumn(skills, "atkInfluence");
+    for(int i=0; i<skills.rows; i++) column[i] = RPG::skills[i+1]->atkInfluence;
+    column = exportColumn(skills, "effectRating");
+    for(int i=0; i<skills.rows; i++) column[i] = RPG::skills[i+1]->effectRating;
+
+    ExportTable& items = tables[1];
+    items.name = "items";
+    items.rows = RPG::items.count();
+    char name[32];
+    for(int a=1; a<=attributeCount; a++) {
+        sprintf(name, "attribute%d", a);
+        column = exportColumn(items, name);
+        for(int i=0; i<items.rows; i++) column[i] = (int) RPG::items[i+1]->attributes[a-1]; }
+
+    ExportTable& monsters = tables[2];
+    monsters.name = "monsters";
+    monsters.rows = RPG::dbMonsters.count();
+    column = exportColumn(monsters, "maxHp");
+    for(int i=0; i<monsters.rows; i++) column[i] = RPG::dbMonsters[i+1]->maxHp;
+    column = exportColumn(monsters, "maxMp");
+    for(int i=0; i<monsters.rows; i++) column[i] = RPG::dbMonsters[i+1]->maxMp;
+    column = exportColumn(monsters, "attack");
+    for(int i=0; i<monsters.rows; i++) column[i] = RPG::dbMonsters[i+1]->attack;
+    column = exportColumn(monsters, "defense");
+    for(int i=0; i<monsters.rows; i++) column[i] = RPG::dbMonsters[i+1]->defense;
+    column = exportColumn(monsters, "intelligence");
+    for(int i=0; i<monsters.rows; i++) column[i] = RPG::dbMonsters[i+1]->intelligence;
+    column = exportColumn(monsters, "agility");
+    for(int i=0; i<monsters.rows; i++) column[i] = RPG::dbMonsters[i+1]->agility;
+    exportRankColumns(monsters, "attribute", attributeCount, false, true);
+    exportRankColumns(monsters, "condition", conditionCount, false, false);
+
+    ExportTable& actors = tables[3];
+    actors.name = "actors";
+    actors.rows = RPG::dbActors.count();
+    column = exportColumn(actors, "criticalHitProbability");
+    for(int i=0; i<actors.rows; i++) column[i] = RPG::dbActors[i+1]->criticalHitProbability;
+    column = exportColumn(actors, "battleGraphicId");
+    for(int i=0; i<actors.rows; i++) column[i] = RPG::dbActors[i+1]->battleGraphicId;
+    exportRankColumns(actors, "attribute", attributeCount, true, true);
+    exportRankColumns(actors, "condition", conditionCount, true, false);
+
+    ExportTable& conditions = tables[4];
+    conditions.name = "conditions";
+    conditions.rows = conditionCount;
+    column = exportColumn(conditions, "priority");
+    for(int i=0; i<conditions.rows; i++) column[i] = RPG::conditions[i+1]->priority;
+    column = exportColumn(conditions, "susA");
+    for(int i=0; i<conditions.rows; i++) column[i] = RPG::conditions[i+1]->susA;
+    column = exportColumn(conditions, "susB");
+    for(int i=0; i<conditions.rows; i++) column[i] = RPG::conditions[i+1]->susB;
+    column = exportColumn(conditions, "susC");
+    for(int i=0; i<conditions.rows; i++) column[i] = RPG::conditions[i+1]->susC;
+    column = exportColumn(conditions, "susD");
+    for(int i=0; i<conditions.rows; i++) column[i] = RPG::conditions[i+1]->susD;
+    column = exportColumn(conditions, "susE");
+    for(int i=0; i<conditions.rows; i++) column[i] = RPG::conditions[i+1]->susE;
+
+    ExportTable& terrains = tables[5];
+    terrains.name = "terrains";
+    terrains.rows = RPG::terrains.count();
+    column = exportColumn(terrains, "initiativePercent");
+    for(int i=0; i<terrains.rows; i++) column[i] = RPG::terrains[i+1]->initiativePercent;
+}
+
+//! Append a 32-bit integer to the export buffer
+void exportPutInt(std::vector<char>& buffer, int value)
+{
+    buffer.insert(buffer.end(), (const char*) &value, (const char*) &value + sizeof(int));
+}
+
+//! Append a length-prefixed string to the export buffer
+void exportPutString(std::vector<char>& buffer, const std::string& text)
+{
+    exportPutInt(buffer, text.size());
+    buffer.insert(buffer.end(), text.begin(), text.end());
+}
+
+//! Write one table as CSV, one row per database ID
+bool exportWriteCsv(const ExportTable& table, const std::string& filename)
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    if(file == NULL)
+        return false;
+    fprintf(file, "id");
+    for(size_t c=0; c<table.columnNames.size(); c++)
+        fprintf(file, ",%s", table.columnNames[c].c_str());
+    for(int i=0; i<table.rows; i++) {
+        fprintf(file, "\n%d", i + 1);
+        for(size_t c=0; c<table.columnNames.size(); c++)
+            fprintf(file, ",%d", table.values[c * table.rows + i]); }
+    fprintf(file, "\n");
+    fclose(file);
+    return true;
+}
+
+//! Export the runtime database tables to a binary file, and optionally to one CSV file per table
+/*!
+    \param filename (const char*) The binary file to write, relative to the main game folder;
+    CSV files are named after it with the table name appended, as in "export.bin.skills.csv"
+    \param csv (bool) Whether to write CSV files as well
+    \return (bool) false if a file could not be written
+*/
+bool exportDatabase(const char* filename, bool csv)
+{
+    std::vector<ExportTable> tables;
+    exportGatherTables(tables);
+    std::vector<char> buffer;
+    size_t size = 12;
+    for(size_t t=0; t<tables.size(); t++) {
+        size += 12 + tables[t].name.size() + tables[t].values.size() * sizeof(int);
+        for(size_t c=0; c<tables[t].columnNames.size(); c++)
+            size += 4 + tables[t].columnNames[c].size(); }
+    buffer.reserve(size);
+    buffer.insert(buffer.end(), "DDAX", "DDAX" + 4);
+    exportPutInt(buffer, EXPORT_VERSION);
+    exportPutInt(buffer, tables.size());
+    for(size_t t=0; t<tables.size(); t++)
+    {
+        exportPutString(buffer, tables[t].name);
+        exportPutInt(buffer, tables[t].rows);
+        exportPutInt(buffer, tables[t].columnNames.size());
+        for(size_t c=0; c<tables[t].columnNames.size(); c++)
+            exportPutString(buffer, tables[t].columnNames[c]);
+        if(!tables[t].values.empty())
+            buffer.insert(buffer.end(), (const char*) &tables[t].values[0], (const char*) &tables[t].values[0] + tables[t].values.size() * sizeof(int));
+    }
+    FILE* file = fopen(filename, "wb");
+    if(file == NULL)
+        return false;
+    bool written = (fwrite(&buffer[0], 1, buffer.size(), file) == buffer.size());
+    fclose(file);
+    for(size_t t=0; csv && t<tables.size(); t++)
+        written = exportWriteCsv(tables[t], std::string(filename) + "." + tables[t].name + ".csv") && written;
+    return written;
+}
+
+// COMMENT COMMAND TRACER
+// Opt-in timeline of the comment commands handled by DynDataAccess, grouped by frame and written
+// as a Chrome trace-event JSON file (open it in chrome://tracing or ui.perfetto.dev). While the
+// tracer runs, events only go into a preallocated buffer; nothing is formatted or written until
+// the trace is stopped. While it is off, onComment pays for a single test of traceEnabled.
+
+const int TRACE_MAX_EVENTS = 65536;         //!< Comment commands recorded per trace before recording stops
+const int TRACE_MAX_FRAMES = 65536;         //!< Frames recorded per trace before recording stops
+
+//! One handled comment command in the trace
+struct TraceEvent
+{
+    long long start;                        //!< Performance counter value when the command started
+    long long end;                          //!< Performance counter value when the command finished
+    int eventId;
+    int pageId;
+    int lineId;
+    char command[64];
+};
+
+bool traceEnabled = false;                  //!< Whether comment commands are currently being traced
+std::string traceFilename;                  //!< File the trace will be written to
+std::vector<TraceEvent> traceEvents;        //!< Recorded comment commands, in order
+std::vector<long long> traceFrameStarts;    //!< Performance counter value at the start of each recorded frame
+long long traceStart;                       //!< Performance counter value when the trace was started
+long long traceFrequency;                   //!< Performance counter ticks per second
+
+//! Read the high resolution performance counter
+long long traceTimestamp()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+//! Convert a performance counter value to microseconds since the start of the trace
+double traceMicroseconds(long long timestamp)
+{
+    return (double) (timestamp - traceStart) * 1000000.0 / (double) traceFrequency;
+}
+
+//! Start tracing comment commands, discarding any previous trace
+void traceBegin(const char* filename)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    traceFrequency = frequency.QuadPart;
+    traceFilename = filename;
+    traceEvents.clear();
+    traceEvents.reserve(TRACE_MAX_EVENTS);
+    traceFrameStarts.clear();
+    traceFrameStarts.reserve(TRACE_MAX_FRAMES);
+    traceStart = traceTimestamp();
+    traceFrameStarts.push_back(traceStart);
+    traceEnabled = true;
+}
+
+//! Mark the start of a new frame in the trace
+void traceFrame()
+{
+    if(traceFrameStarts.size() < (size_t) TRACE_MAX_FRAMES)
+        traceFrameStarts.push_back(traceTimestamp());
+}
+
+//! Add a handled comment command to the trace
+void traceRecordComment(const char* command, int eventId, int pageId, int lineId, long long start, long long end)
+{
+    if(traceEvents.size() >= (size_t) TRACE_MAX_EVENTS)
+        return;
+    traceEvents.push_back(TraceEvent());
+    TraceEvent& event = traceEvents.back();
+    event.start = start;
+    event.end = end;
+    event.eventId = eventId;
+    event.pageId = pageId;
+    event.lineId = lineId;
+    strncpy(event.command, command, sizeof(event.command) - 1);
+    event.command[sizeof(event.command) - 1] = '\0';
+}
+
+//! Stop tracing and write the trace to its file
+/*!
+    Frames become slices named "frame N", and each comment command becomes a slice nested in the
+    frame it ran in, with the event ID, page ID and line ID as arguments.
+*/
+void traceEnd()
+{
+    if(!traceEnabled)
+        return;
+    traceEnabled = false;
+    long long end = traceTimestamp();
+    FILE* file = fopen(traceFilename.c_str(), "w");
+    if(file == NULL)
+        return;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"RPG_RT\"}}");
+    for(size_t i=0; i<traceFrameStarts.size(); i++)
+    {
+        long long frameEnd = (i + 1 < traceFrameStarts.size()) ? traceFrameStarts[i+1] : end;
+        fprintf(file, ",\n{\"name\":\"frame %u\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                (unsigned int) i, traceMicroseconds(traceFrameStarts[i]),
+                traceMicroseconds(frameEnd) - traceMicroseconds(traceFrameStarts[i]));
+    }
+    for(size_t i=0; i<traceEvents.size(); i++)
+    {
+        const TraceEvent& event = traceEvents[i];
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"comment\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,"
+                "\"args\":{\"eventId\":%d,\"pageId\":%d,\"lineId\":%d}}",
+                event.command, traceMicroseconds(event.start),
+                traceMicroseconds(event.end) - traceMicroseconds(event.start),
+                event.eventId, event.pageId, event.lineId);
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+}
+
+// MAP PROPERTY CACHE
+// Map tree lookups are kept by map ID, since the tree index of a map never changes while the game
+// runs. The per-map encounter rate overrides are stored here too; they are reapplied every time
+// their map is loaded and saved along with the game.
+
+const int MAP_SEARCH_MARGIN = 10000;        //!< Farthest off the map the center of a map search may lie, in tiles
+
+std::map<int, int> mapTreeIndices;          //!< Map ID -> map tree index, filled the first time each map is looked up
+std::map<int, int> encounterRateOverrides;  //!< Map ID -> encounter rate to apply whenever that map is loaded
+int currentMapId = 0;                       //!< ID of the map the cached data below belongs to, 0 if none
+int mapLoadCount = 0;                       //!< Number of map changes seen, so other caches can tell when to refresh
+RPG::MapTreeProperties* currentMapTreeProperties = NULL; //!< Map tree properties of the current map
+
+//! Get the map tree index of a map, asking DynRPG only the first time
+int getCachedTreeIndex(int mapId)
+{
+    std::map<int, int>::iterator found = mapTreeIndices.find(mapId);
+    if(found != mapTreeIndices.end())
+        return found->second;
+    int treeIndex = RPG::mapTree->getTreeIndex(mapId);
+    mapTreeIndices[mapId] = treeIndex;
+    return treeIndex;
+}
+
+//! Refresh the cached data for the current map after a map change
+/*!
+    Does nothing unless a different map has been loaded since the last call, so it is cheap enough
+    to call every frame and before every map query. On a map change, the map's encounter rate
+    override (if any) is applied.
+*/
+void updateMapCache()
+{
+    int mapId = RPG::map->properties->id;
+    if(mapId == currentMapId)
+        return;
+    currentMapId = mapId;
+    mapLoadCount++;
+    currentMapTreeProperties = RPG::mapTree->properties[getCachedTreeIndex(mapId)];
+    std::map<int, int>::iterator found = encounterRateOverrides.find(mapId);
+    if(found != encounterRateOverrides.end())
+        RPG::map->encounterRateNew = found->second;
+}
+
+//! Move a tile lying more than MAP_SEARCH_MARGIN tiles off the map to that distance
+void clampMapPoint(int& x, int& y)
+{
+    int width = RPG::map->getWidth();
+    int height = RPG::map->getHeight();
+    x = (x < -MAP_SEARCH_MARGIN) ? -MAP_SEARCH_MARGIN : (x > width + MAP_SEARCH_MARGIN ? width + MAP_SEARCH_MARGIN : x);
+    y = (y < -MAP_SEARCH_MARGIN) ? -MAP_SEARCH_MARGIN : (y > height + MAP_SEARCH_MARGIN ? height + MAP_SEARCH_MARGIN : y);
+}
+
+//! Bring the center and radius of a map search into a range where squared distances cannot overflow
+/*!
+    The radius is cut down to the distance from the center to the farthest corner of the map, since
+    no tile lies beyond it, and a negative radius counts as 0. A center more than
+    MAP_SEARCH_MARGIN tiles off the map is moved to that distance.
+*/
+void clampMapSearch(int& x, int& y, int& radius)
+{
+    int width = RPG::map->getWidth();
+    int height = RPG::map->getHeight();
+    clampMapPoint(x, y);
+    int farX = (x > width - 1 - x) ? x : width - 1 - x;
+    int farY = (y > height - 1 - y) ? y : height - 1 - y;
+    if(farX < 0) farX = -farX;
+    if(farY < 0) farY = -farY;
+    if(radius > farX + farY)                // Never less than the Euclidean distance to that corner
+        radius = farX + farY;
+    if(radius < 0)
+        radius = 0;
+}
+
+// TERRAIN GRID
+// The terrain ID of every tile of the current map, read from DynRPG the first time a terrain query
+// runs after a map is loaded. For each terrain ID that gets queried, a summed-area table (the
+// number of tiles of that terrain above and to the left of each tile) is built as well, which
+// answers rectangle counts in constant time and circle counts in one step per row.
+
+int terrainGridMapLoad = -1;                //!< Value of mapLoadCount when the grid was read, -1 if never
+int terrainGridWidth = 0;
+int terrainGridHeight = 0;
+std::vector<int> terrainGrid;               //!< Terrain ID by tile, row after row
+std::map<int, std::vector<int> > terrainCounts; //!< Terrain ID -> summed-area table of (width+1)*(height+1) entries
+
+//! Make sure the terrain grid belongs to the current map, reading it from DynRPG if it does not
+void updateTerrainGrid()
+{
+    updateMapCache();
+    if(terrainGridMapLoad == mapLoadCount)
+        return;
+    terrainGridMapLoad = mapLoadCount;
+    terrainGridWidth = RPG::map->getWidth();
+    terrainGridHeight = RPG::map->getHeight();
+    terrainGrid.resize(terrainGridWidth * terrainGridHeight);
+    for(int y=0; y<terrainGridHeight; y++) {
+        for(int x=0; x<terrainGridWidth; x++)
+            terrainGrid[y * terrainGridWidth + x] = RPG::map->getTerrainId(x, y); }
+    terrainCounts.clear();
+}
+
+//! Forget the terrain grid so it is read again on the next query, for when tiles were changed by events
+void invalidateTerrainGrid()
+{
+    terrainGridMapLoad = -1;
+}
+
+//! Get the terrain ID of a tile, or 0 if the tile is off the map
+int terrainAt(int x, int y)
+{
+    if(x < 0 || y < 0 || x >= terrainGridWidth || y >= terrainGridHeight)
+        return 0;
+    return terrainGrid[y * terrainGridWidth + x];
+}
+
+//! Get the summed-area table of a terrain ID, building it the first time it is needed on this map
+const std::vector<int>& terrainCountTable(int terrainId)
+{
+    std::map<int, std::vector<int> >::iterator found = terrainCounts.find(terrainId);
+    if(found != terrainCounts.end())
+        return found->second;
+    std::vector<int>& table = terrainCounts[terrainId];
+    int stride = terrainGridWidth + 1;
+    table.assign(stride * (terrainGridHeight + 1), 0);
+    for(int y=0; y<terrainGridHeight; y++) {
+        int rowCount = 0;
+        for(int x=0; x<terrainGridWidth; x++) {
+            rowCount += (terrainGrid[y * terrainGridWidth + x] == terrainId) ? 1 : 0;
+            table[(y + 1) * stride + x + 1] = table[y * stride + x + 1] + rowCount; } }
+    return table;
+}
+
+//! Count the tiles of a terrain ID in a rectangle (corners included, clipped to the map)
+int countTerrainInRect(int terrainId, int x1, int y1, int x2, int y2)
+{
+    if(x1 > x2) std::swap(x1, x2);
+    if(y1 > y2) std::swap(y1, y2);
+    if(x1 < 0) x1 = 0;
+    if(y1 < 0) y1 = 0;
+    if(x2 >= terrainGridWidth) x2 = terrainGridWidth - 1;
+    if(y2 >= terrainGridHeight) y2 = terrainGridHeight - 1;
+    if(x1 > x2 || y1 > y2)
+        return 0;
+    const std::vector<int>& table = terrainCountTable(terrainId);
+    int stride = terrainGridWidth + 1;
+    return table[(y2 + 1) * stride + x2 + 1] - table[y1 * stride + x2 + 1]
+         - table[(y2 + 1) * stride + x1] + table[y1 * stride + x1];
+}
+
+//! Count the tiles of a terrain ID within a radius of a tile (Euclidean distance, center included)
+int countTerrainInRadius(int terrainId, int x, int y, int radius)
+{
+    int count = 0;
+    int halfWidth = 0;
+    for(int dy=radius; dy>=0; dy--) {   // Walk outward from the edge so the half-width only grows
+        while((halfWidth + 1) * (halfWidth + 1) + dy * dy <= radius * radius)
+            halfWidth++;
+        count += countTerrainInRect(terrainId, x - halfWidth, y - dy, x + halfWidth, y - dy);
+        if(dy > 0)
+            count += countTerrainInRect(terrainId, x - halfWidth, y + dy, x + halfWidth, y + dy); }
+    return count;
+}
+
+//! Store the positions of up to maxCount tiles of a terrain ID in a rectangle, row by row
+/*!
+    \param radius (int) If 0 or more, only tiles within this distance of (centerX, centerY) count
+    \return (int) The number of positions stored
+*/
+int locateTerrain(int terrainId, int x1, int y1, int x2, int y2, int centerX, int centerY, int radius,
+                  int* positions, int maxCount)
+{
+    if(x1 > x2) std::swap(x1, x2);
+    if(y1 > y2) std::swap(y1, y2);
+    int found = 0;
+    for(int y=(y1 < 0 ? 0 : y1); y<=y2 && y<terrainGridHeight && found<maxCount; y++)
+    {
+        if(countTerrainInRect(terrainId, x1, y, x2, y) == 0)
+            continue;                       // Skip rows without any matching tile
+        for(int x=(x1 < 0 ? 0 : x1); x<=x2 && x<terrainGridWidth && found<maxCount; x++)
+        {
+            if(terrainGrid[y * terrainGridWidth + x] != terrainId)
+                continue;
+            if(radius >= 0 && (x - centerX) * (x - centerX) + (y - centerY) * (y - centerY) > radius * radius)
+                continue;
+            positions[found * 2] = x;
+            positions[found * 2 + 1] = y;
+            found++;
+        }
+    }
+    return found;
+}
+
+//! Find the nearest tile of a terrain ID to a tile, searching outward ring by ring
+/*!
+    \return (bool) false if there is no such tile within maxRadius (Euclidean distance)
+*/
+bool findNearestTerrain(int terrainId, int x, int y, int maxRadius, int& foundX, int& foundY)
+{
+    int bestDistance = maxRadius * maxRadius + 1;
+    for(int ring=0; ring*ring<bestDistance; ring++)
+    {
+        if(countTerrainInRect(terrainId, x - ring, y - ring, x + ring, y + ring) == 0)
+            continue;                       // Nothing within this square, so nothing on this ring
+        for(int dy=-ring; dy<=ring; dy++) {
+            int step = (dy == -ring || dy == ring) ? 1 : ring * 2;  // Only the edges of the ring
+            for(int dx=-ring; dx<=ring; dx+=step) {
+                int distance = dx * dx + dy * dy;
+                if(distance < bestDistance && x + dx >= 0 && y + dy >= 0 && x + dx < terrainGridWidth
+                   && y + dy < terrainGridHeight && terrainGrid[(y + dy) * terrainGridWidth + x + dx] == terrainId) {
+                    bestDistance = distance;
+                    foundX = x + dx;
+                    foundY = y + dy; } } }
+    }
+    return bestDistance <= maxRadius * maxRadius;
+}
+
+// EVENT SPATIAL INDEX
+// A uniform grid over the current map in which every map event is filed under the cell it stands
+// in. onFrame moves an event to another cell only when it crosses a cell border, so keeping the
+// index current costs one position comparison per event per frame, and proximity queries only
+// look at the events in nearby cells.
+
+const int EVENT_CELL_SIZE = 8;              //!< Width and height of a grid cell in tiles
+
+//! Where an event was last filed in the grid
+struct IndexedEvent
+{
+    int id;                                 //!< The event's own ID, which need not match its position
+    int x;
+    int y;
+    int cell;                               //!< Index into eventCells
+    int slot;                               //!< Position within its cell's list
+};
+
+int eventIndexMapLoad = -1;                 //!< Value of mapLoadCount when the index was built, -1 if never
+int eventCellColumns = 0;
+int eventCellRows = 0;
+std::vector<std::vector<int> > eventCells;  //!< Positions in indexedEvents by grid cell
+std::vector<IndexedEvent> indexedEvents;    //!< In the order of RPG::map->events
+
+//! Grid cell of a tile, clamped to the grid
+int eventCellOf(int x, int y)
+{
+    int column = x / EVENT_CELL_SIZE;
+    int row = y / EVENT_CELL_SIZE;
+    column = (x < 0) ? 0 : (column >= eventCellColumns ? eventCellColumns - 1 : column);
+    row = (y < 0) ? 0 : (row >= eventCellRows ? eventCellRows - 1 : row);
+    return row * eventCellColumns + column;
+}
+
+//! File an event under the cell of its recorded position
+void eventIndexInsert(int position)
+{
+    IndexedEvent& event = indexedEvents[position];
+    event.cell = eventCellOf(event.x, event.y);
+    event.slot = eventCells[event.cell].size();
+    eventCells[event.cell].push_back(position);
+}
+
+//! Take an event out of its cell, filling the gap with the cell's last event
+void eventIndexRemove(int position)
+{
+    IndexedEvent& event = indexedEvents[position];
+    std::vector<int>& cell = eventCells[event.cell];
+    int moved = cell.back();
+    cell[event.slot] = moved;
+    indexedEvents[moved].slot = event.slot;
+    cell.pop_back();
+}
+
+//! Rebuild the whole index for the current map
+void rebuildEventIndex()
+{
+    eventIndexMapLoad = mapLoadCount;
+    eventCellColumns = (RPG::map->getWidth() + EVENT_CELL_SIZE - 1) / EVENT_CELL_SIZE;
+    eventCellRows = (RPG::map->getHeight() + EVENT_CELL_SIZE - 1) / EVENT_CELL_SIZE;
+    if(eventCellColumns < 1) eventCellColumns = 1;
+    if(eventCellRows < 1) eventCellRows = 1;
+    eventCells.resize(eventCellColumns * eventCellRows);
+    for(size_t i=0; i<eventCells.size(); i++)
+        eventCells[i].clear();
+    int eventCount = RPG::map->events.count();
+    indexedEvents.resize(eventCount);
+    for(int i=0; i<eventCount; i++) {
+        indexedEvents[i].id = RPG::map->events[i]->id;
+        indexedEvents[i].x = RPG::map->events[i]->x;
+        indexedEvents[i].y = RPG::map->events[i]->y;
+        eventIndexInsert(i); }
+}
+
+//! Bring the index up to date with the current map and event positions
+void updateEventIndex()
+{
+    updateMapCache();
+    if(eventIndexMapLoad != mapLoadCount || (int) indexedEvents.size() != RPG::map->events.count()) {
+        rebuildEventIndex();
+        return; }
+    for(size_t i=0; i<indexedEvents.size(); i++)
+    {
+        IndexedEvent& event = indexedEvents[i];
+        RPG::Event* mapEvent = RPG::map->events[i];
+        if(mapEvent->id != event.id) {       // Events were added or removed; start over
+            rebuildEventIndex();
+            return; }
+        if(mapEvent->x == event.x && mapEvent->y == event.y)
+            continue;
+        event.x = mapEvent->x;
+        event.y = mapEvent->y;
+        if(eventCellOf(event.x, event.y) != event.cell) {
+            eventIndexRemove(i);
+            eventIndexInsert(i); }
+    }
+}
+
+//! Collect the IDs of events in a rectangle (corners included), optionally only those within a radius of a tile
+/*!
+    \param radius (int) If 0 or more, only events within this distance of (centerX, centerY) count
+    \param found (std::vector<int>&) Receives the event IDs, nearest first if a radius is given, by ID otherwise
+*/
+void findEvents(int x1, int y1, int x2, int y2, int centerX, int centerY, int radius, std::vector<int>& found)
+{
+    if(x1 > x2) std::swap(x1, x2);
+    if(y1 > y2) std::swap(y1, y2);
+    static std::vector<int> distances;      // Squared distance of each found event, kept in step with found
+    found.clear();
+    distances.clear();
+    int firstCell = eventCellOf(x1, y1);
+    int lastCell = eventCellOf(x2, y2);
+    for(int row=firstCell/eventCellColumns; row<=lastCell/eventCellColumns; row++) {
+        for(int column=firstCell%eventCellColumns; column<=lastCell%eventCellColumns; column++) {
+            const std::vector<int>& cell = eventCells[row * eventCellColumns + column];
+            for(size_t i=0; i<cell.size(); i++) {
+                const IndexedEvent& event = indexedEvents[cell[i]];
+                if(event.x < x1 || event.x > x2 || event.y < y1 || event.y > y2)
+                    continue;
+                int distance = 0;
+                if(radius >= 0) {
+                    distance = (event.x - centerX) * (event.x - centerX) + (event.y - centerY) * (event.y - centerY);
+                    if(distance > radius * radius)
+                        continue; }
+                found.push_back(event.id);
+                distances.push_back(distance); } } }
+    if(radius < 0) {
+        std::sort(found.begin(), found.end());
+        return; }
+    // Order by distance, then by ID; event lists near one tile are short, so insertion sort will do
+    for(size_t i=1; i<found.size(); i++) {
+        int id = found[i];
+        int distance = distances[i];
+        size_t j = i;
+        for(; j>0; j--) {
+            if(distances[j-1] < distance || (distances[j-1] == distance && found[j-1] < id))
+                break;
+            found[j] = found[j-1];
+            distances[j] = distances[j-1]; }
+        found[j] = id;
+        distances[j] = distance; }
+}
+
+//! Find the event nearest to a tile, searching outward cell ring by cell ring
+/*!
+    \param ignoreId (int) An event ID to leave out, such as the event asking; 0 for none
+    \return (int) The event's position in indexedEvents, or -1 if there is no event within maxRadius
+*/
+int findNearestEvent(int x, int y, int maxRadius, int ignoreId)
+{
+    int best = -1;
+    int bestId = 0;
+    int bestDistance = maxRadius * maxRadius + 1;
+    int centerCell = eventCellOf(x, y);
+    int centerColumn = centerCell % eventCellColumns;
+    int centerRow = centerCell / eventCellColumns;
+    int maxRing = (eventCellColumns > eventCellRows) ? eventCellColumns : eventCellRows;
+    for(int ring=0; ring<=maxRing; ring++)
+    {
+        // Every event in this ring of cells or beyond is at least (ring - 1) cells away
+        int nearest = (ring - 1) * EVENT_CELL_SIZE + 1;
+        if(ring > 1 && nearest * nearest > bestDistance)
+            break;
+        for(int row=centerRow-ring; row<=centerRow+ring; row++) {
+            if(row < 0 || row >= eventCellRows)
+                continue;
+            int step = (row == centerRow - ring || row == centerRow + ring) ? 1 : ring * 2;
+            for(int column=centerColumn-ring; column<=centerColumn+ring; column+=step) {
+                if(column < 0 || column >= eventCellColumns)
+                    continue;
+                const std::vector<int>& cell = eventCells[row * eventCellColumns + column];
+                for(size_t i=0; i<cell.size(); i++) {
+                    const IndexedEvent& event = indexedEvents[cell[i]];
+                    int distance = (event.x - x) * (event.x - x) + (event.y - y) * (event.y - y);
+                    if(event.id != ignoreId && (distance < bestDistance || (distance == bestDistance && event.id < bestId))) {
+                        bestDistance = distance;
+                        best = cell[i];
+                        bestId = event.id; } } } }
+    }
+    return best;
+}
+
+//! Check whether a straight line of tiles between two tiles is free of a blocking terrain
+/*!
+    The line is traced with Bresenham's algorithm; the two end tiles themselves are not checked.
+    Both ends must lie within MAP_SEARCH_MARGIN tiles of the map (see clampMapPoint).
+*/
+bool hasLineOfSight(int x1, int y1, int x2, int y2, int blockingTerrainId)
+{
+    int dx = (x2 > x1) ? x2 - x1 : x1 - x2;
+    int dy = (y2 > y1) ? y2 - y1 : y1 - y2;
+    int stepX = (x1 < x2) ? 1 : -1;
+    int stepY = (y1 < y2) ? 1 : -1;
+    int error = dx - dy;
+    int x = x1, y = y1;
+    for(;;)
+    {
+        int doubled = error * 2;
+        if(doubled > -dy) {
+            error -= dy;
+            x += stepX; }
+        if(doubled < dx) {
+            error += dx;
+            y += stepY; }
+        if(x == x2 && y == y2)
+            return true;
+        if(terrainAt(x, y) == blockingTerrainId)
+            return false;
+    }
+}
+
+// DYNRPG CALLBACKS
+// Functions DynRPG calls at fixed points of the game loop, used to keep the caches above current.
+// Comment commands are handled separately, in handleCommentCommand below.
+
+//! Keep per-frame caches up to date
+/*!
+    onFrame() is called once per frame, before the scene is drawn.
+
+    \param scene (RPG::Scene) The current scene
+*/
+void onFrame(RPG::Scene scene)
+{
+    if(traceEnabled)
+        traceFrame();
+    if(scene == RPG::SCENE_MAP) {
+        updateMapCache();
+        updateEventIndex(); }
+    if(scene == RPG::SCENE_BATTLE) {
+        updateTroopProfile();
+        drainEffectQueue(); }
+    else {
+        troopProfile.valid = false;
+        effectQueueCount = 0; }
+}
+
+//! Write out any trace still running when the game closes
+void onExit()
+{
+    traceEnd();
+}
+
+//! Reset plugin state for a new game
+void onNewGame()
+{
+    encounterRateOverrides.clear();
+    currentMapId = 0;
+}
+
+//! Store the encounter rate overrides in the savegame
+/*!
+    \param id (int) The savegame slot
+    \param savePluginData (function pointer) Function which stores the plugin's data in the savegame
+*/
+void onSaveGame(int id, void __cdecl (*savePluginData)(char* data, int length))
+{
+    std::vector<int> data;
+    for(std::map<int, int>::iterator i=encounterRateOverrides.begin(); i!=encounterRateOverrides.end(); ++i) {
+        data.push_back(i->first);
+        data.push_back(i->second); }
+    if(!data.empty())
+        savePluginData((char*) &data[0], data.size() * sizeof(int));
+}
+
+//! Restore the encounter rate overrides from the savegame
+/*!
+    \param id (int) The savegame slot
+    \param data (char*) The data stored by onSaveGame, NULL if there was none
+    \param length (int) The size of the data in bytes
+*/
+void onLoadGame(int id, char* data, int length)
+{
+    encounterRateOverrides.clear();
+    currentMapId = 0;                       // The loaded map gets its override applied on the next frame
+    const int* values = (const int*) data;
+    for(int i=0; i+1<length/(int)sizeof(int); i+=2)
+        encounterRateOverrides[values[i]] = values[i+1];
+}
+
 //! Respond to potential comment commands
 /*!
-    onComment() is called when the game runs across a comment line in its event scripting. Comment
-    commands are how the user communicates with the plugin, so this function checks for comment
-    commands and responds accordingly.
+    handleCommentCommand() is called by onComment() whenever the game runs across a comment line in
+    its event scripting. Comment commands are how the user communicates with the plugin, so this
+    function checks for comment commands and responds accordingly.
 
     \param text (const char*) The comment's content as simple text
     \param parsedData (const RPG::ParsedCommentData*) The already parsed data
@@ -46,7 +1767,7 @@
     \param nextLineId (int*) Pointer to the next executed line number (-1 for default)
     \return (bool) false will prevent other plugins from receiving this notification, use true otherwise
 */
-bool onComment( const char* text,
+bool handleCommentCommand( const char* text,
                 const RPG::ParsedCommentData* 	parsedData,
                 RPG::EventScriptLine* 	nextScriptLine,
                 RPG::EventScriptData* 	scriptData,
@@ -55,7 +1776,7 @@ bool onComment( const char* text,
                 int 	lineId,
                 int* 	nextLineId )
 {
-    static std::string cmd;         // The portion of the comment text representing a comment command, if any
+    const char* cmd;                // The portion of the comment text representing a comment command, if any
     static int variableIndex;       // The index of the RM2K3 variable to store data in or read data from
     static int dataValue;           // The data value read from DynRPG or to write to DynRPG
     static int partyIndex;          // The party position (NOT ID number) of an actor (1-4) or enemy (1-8)
@@ -64,7 +1785,7 @@ bool onComment( const char* text,
     static int itemIndex;           // The item database ID
     static int conditionIndex;      // The condition database ID
     static int terrainIndex;        // The terrain database ID
-    std::string textString;         // For the manipulation of strings and accepting of text input
+    const std::string* textString;  // Pooled copy of a text parameter (see internText)
     const int MAX_ACTORS = 4;                           //!< Maximum number of actors in a battle
     const int MAX_MONSTERS = 8;                         //!< Maximum number of monsters in a battle
     // ^ADD MORE STATIC VARIABLES AS NEEDED HERE
@@ -78,7 +1799,7 @@ bool onComment( const char* text,
     // established style, and use the static variables declared above rather than local variables
     // when feasible. For those who are more well-versed in programming practices, yes, it would be
     // better form to have separate functions for each comment command and merely call them from
-    // onComment rather than have the functional code here. However, since the code for each comment
+    // handleCommentCommand rather than have the functional code here. However, since the code for each comment
     // command is likely to be fairly short, and some contributors may be confused by having to
     // update multiple areas of code, this simple format is preferred. There are somewhat more
     // detailed instructions in the readme.html file, including how to find the data you're looking
@@ -95,7 +1816,7 @@ bool onComment( const char* text,
 
     // Contributed by DJC
 
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_id" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_id" ) )
     {   // Sets desired game variable to database ID of actor in requested party member slot (1-4)
         // If requested slot empty, variable is set to 0
         // Parameter 0: The index of the RM2K3 variable to store data
@@ -109,7 +1830,7 @@ bool onComment( const char* text,
             RPG::variables[variableIndex] = 0;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_all_ids" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_all_ids" ) )
     {   // Sets four sequential game variables to database IDs of the actors in the party
         // If any slots are empty, the corresponding variable is set to 0
         // Parameter 0: The index of the first of four sequential RM2K3 variables to store data in
@@ -122,7 +1843,7 @@ bool onComment( const char* text,
                 RPG::variables[variableIndex+i] = 0; }
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_party_member_critical_rate" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_party_member_critical_rate" ) )
     {   // Set party member critical hit rate percentage (1 out of dataValue chance; Example: 1 out of 2 = 50%)
         // Volatile change, must be reapplied after every load
         // Parameter 0: The value to set data to
@@ -133,7 +1854,7 @@ bool onComment( const char* text,
         RPG::dbActors[RPG::Actor::partyMember(partyIndex)->id]->criticalHitProbability = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_party_member_guard_type" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_party_member_guard_type" ) )
     {   // Set party member guard to regular (0) or mighty (1)
         // Parameter 0: The value to set data to
         dataValue = (int) parsedData->parameters[0].number;
@@ -144,7 +1865,7 @@ bool onComment( const char* text,
             RPG::Actor::partyMember(partyIndex)->mightyGuard = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_database_attribute_resistance" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_database_attribute_resistance" ) )
     {   // Get database default party member attribute resistance percentage
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -165,7 +1886,7 @@ bool onComment( const char* text,
             RPG::variables[variableIndex] = RPG::attributes[attributeIndex]->dmgE;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_party_member_database_attribute_resistance" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_party_member_database_attribute_resistance" ) )
     {   // Set party member database default attribute resistance
         // Volatile change, must be reapplied on load
         // RM2K3 allows only one increase/decrease from this level of resistance
@@ -181,7 +1902,7 @@ bool onComment( const char* text,
             RPG::dbActors[RPG::Actor::partyMember(partyIndex)->id]->attributes[attributeIndex] = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_current_attribute_resistance" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_current_attribute_resistance" ) )
     {   // Get current attribute resistance of a party member
         // Base resistance is default adjusted by any equipment boosts
         // 0=one resist level down from base; 1=base; 2=one level up from base; 3=two levels up; etc...
@@ -197,7 +1918,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::Actor::partyMember(partyIndex)->attributes[attributeIndex];
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_party_member_current_attribute_resistance" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_party_member_current_attribute_resistance" ) )
     {   // Set party member current attribute resistance
         // Base resistance is default adjusted by any equipment boosts
         // 0=one resist level down from base; 1=base; 2=one level up from base; 3=two levels up; etc...
@@ -214,7 +1935,7 @@ bool onComment( const char* text,
         RPG::Actor::partyMember(partyIndex)->attributes[attributeIndex] = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_condition_turns" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_condition_turns" ) )
     {   // Get the number of turns a party member has been afflicted with the requested condition
         // 0=not currently afflicted with requested condition
         // Parameter 0: The index of the RM2K3 variable to store data in
@@ -227,7 +1948,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::Actor::partyMember(partyIndex)->conditions[conditionIndex];
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_condition_turns_total" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_condition_turns_total" ) )
     {   // Get the number of turns a party member has been afflicted with all conditions
         // Ignores any conditions with a priority lower than requested
         // Returned value of 0 = not currently afflicted with any condition
@@ -245,7 +1966,7 @@ bool onComment( const char* text,
                     RPG::variables[variableIndex] += RPG::Actor::partyMember(partyIndex)->conditions[i]; }
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_condition_total" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_condition_total" ) )
     {   // Get the number of conditions a party member is currently suffering
         // Ignores any conditions with a priority lower than requested
         // Returned value of 0 = not currently afflicted with any condition
@@ -263,7 +1984,7 @@ bool onComment( const char* text,
                     RPG::variables[variableIndex]++; }
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_database_condition_resistance" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_database_condition_resistance" ) )
     {   // Get database default party member condition resistance percentage
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -284,7 +2005,7 @@ bool onComment( const char* text,
             RPG::variables[variableIndex] = RPG::conditions[conditionIndex]->susE;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_party_member_database_condition_resistance" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_party_member_database_condition_resistance" ) )
     {   // Set party member database default condition resistance
         // Volatile change, must be reapplied on load
         // Equipment condition resistances still override like normal
@@ -299,7 +2020,7 @@ bool onComment( const char* text,
             RPG::dbActors[RPG::Actor::partyMember(partyIndex)->id]->conditions[conditionIndex] = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_party_member_combo" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_party_member_combo" ) )
     {   // Set party member combo command and repetitions
         // Only one command can be setup for a combo per party member
         // Some commands cannot be set to combo (Item, Defend, etc...)
@@ -315,7 +2036,7 @@ bool onComment( const char* text,
         RPG::Actor::partyMember(partyIndex)->comboRepetitions = numHits;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_animation2" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_animation2" ) )
     {   // Get party member Animations2 ID
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -325,7 +2046,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::dbActors[RPG::Actor::partyMember(partyIndex)->id]->battleGraphicId;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_party_member_animation2" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_party_member_animation2" ) )
     {   // Set party member Animation2 ID
         // Only works outside of battle
         // Parameter 0: The Animation2 database ID
@@ -336,7 +2057,7 @@ bool onComment( const char* text,
         RPG::dbActors[RPG::Actor::partyMember(partyIndex)->id]->battleGraphicId = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_party_member_defeated_count" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_party_member_defeated_count" ) )
     {   // Gets the number of fallen party members in the party
         // Parameter 0: The RM2K3 variable to store data
         variableIndex = (int) parsedData->parameters[0].number;
@@ -352,12 +2073,12 @@ bool onComment( const char* text,
 
     // Contributed by DJC
 
-    if( 0 == cmd.compare( "dyndataaccess_set_battle_bg" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_battle_bg" ) )
     {   // Set battle background
         // Parameter 0: The filename of the battle background, directory included relative to main game folder
-        textString = parsedData->parameters[0].text;
+        textString = &internText(parsedData->parameters[0].text);
         // Alter the data to the desired value
-        RPG::battleData->backdropImage->loadFromFile(textString);
+        RPG::battleData->backdropImage->loadFromFile(*textString);
         return false;
     }
     //!do one for changing frames
@@ -367,21 +2088,132 @@ bool onComment( const char* text,
 
     // Contributed by DJC
 
-    if( 0 == cmd.compare( "dyndataaccess_get_troop_initial_size" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_troop_initial_size" ) )
     {   // Get the initial enemy troop size as defined in the database
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
         // Store the data in the appropriate RM2K3 variable
-        RPG::variables[variableIndex] = RPG::dbMonsterGroups[RPG::battleData->monsterGroupId]->monsterList.count();
+        updateTroopProfile();
+        RPG::variables[variableIndex] = troopProfile.initialSize;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_troop_hp_mp_totals" ) )
+    {   // Get the total and highest database max HP and MP of the enemies in battle
+        // Stores four sequential variables: total max HP, highest max HP, total max MP, highest max MP
+        // Parameter 0: The index of the first of four sequential RM2K3 variables to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Store the data in the appropriate RM2K3 variables
+        updateTroopProfile();
+        RPG::variables[variableIndex] = troopProfile.totalMaxHp;
+        variableIndex++;
+        RPG::variables[variableIndex] = troopProfile.highestMaxHp;
+        variableIndex++;
+        RPG::variables[variableIndex] = troopProfile.totalMaxMp;
+        variableIndex++;
+        RPG::variables[variableIndex] = troopProfile.highestMaxMp;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_troop_any_weakness" ) )
+    {   // Get whether at least one enemy in battle is weak (database rank A or B) to an attribute
+        // Parameter 0: The index of the RM2K3 variable to store data in (0=false, 1=true)
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The attribute database id
+        attributeIndex = (int) parsedData->parameters[1].number;
+        // Store the data in the appropriate RM2K3 variable
+        updateTroopProfile();
+        RPG::variables[variableIndex] = (attributeIndex > 0 && attributeIndex < (int) troopProfile.anyWeak.size()) ? troopProfile.anyWeak[attributeIndex] : 0;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_troop_shared_weakness" ) )
+    {   // Get whether every enemy in battle is weak (database rank A or B) to an attribute
+        // Parameter 0: The index of the RM2K3 variable to store data in (0=false, 1=true)
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The attribute database id
+        attributeIndex = (int) parsedData->parameters[1].number;
+        // Store the data in the appropriate RM2K3 variable
+        updateTroopProfile();
+        RPG::variables[variableIndex] = (attributeIndex > 0 && attributeIndex < (int) troopProfile.allWeak.size()) ? troopProfile.allWeak[attributeIndex] : 0;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_troop_slot_database_stats" ) )
+    {   // Get the database stats of the enemy in a troop slot
+        // Stores seven sequential variables: database ID, max HP, max MP, attack, defense,
+        // intelligence, agility; all 0 if the slot is empty or the party index is not 1-8
+        // Parameter 0: The index of the first of seven sequential RM2K3 variables to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The party index of the enemy
+        partyIndex = (int) parsedData->parameters[1].number - 1;
+        // Store the data in the appropriate RM2K3 variables
+        if(partyIndex < 0 || partyIndex >= TROOP_SLOTS) {
+            for(int i=0; i<7; i++)
+                RPG::variables[variableIndex+i] = 0;
+            return false; }
+        updateTroopProfile();
+        const TroopSlot& slot = troopProfile.slots[partyIndex];
+        RPG::variables[variableIndex] = slot.databaseId;
+        variableIndex++;
+        RPG::variables[variableIndex] = slot.maxHp;
+        variableIndex++;
+        RPG::variables[variableIndex] = slot.maxMp;
+        variableIndex++;
+        RPG::variables[variableIndex] = slot.attack;
+        variableIndex++;
+        RPG::variables[variableIndex] = slot.defense;
+        variableIndex++;
+        RPG::variables[variableIndex] = slot.intelligence;
+        variableIndex++;
+        RPG::variables[variableIndex] = slot.agility;
         return false;
     }
     // END OF DATABASE TROOP DATA SECTION
 
+    // BATTLE SIMULATION SECTION
+    // This section contains commands for simulating battles outside of the battle scene, for
+    // checking raw stat balance. See simulateBattle above for what is and isn't modelled.
+
+    if( 0 == strcmp( cmd, "dyndataaccess_simulate_battle" ) )
+    {   // Simulate many battles of a database troop against the current party
+        // Stores seventeen sequential variables: battles won, win rate (tenths of a percent), then the
+        // mean, minimum, median, 90th percentile and maximum of the turns taken by won battles, of
+        // the damage dealt by the party and of the damage taken by the party
+        // The same seed always gives the same results; the game pauses until all battles are done
+        // Parameter 0: The index of the first of seventeen sequential RM2K3 variables to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The database ID of the troop
+        int troopId = (int) parsedData->parameters[1].number;
+        // Parameter 2: The number of battles to simulate, at most 100000
+        int battleCount = (int) parsedData->parameters[2].number;
+        // Parameter 3: The random seed
+        unsigned int seed = (unsigned int) parsedData->parameters[3].number;
+        // Run the simulation and store the results
+        runBattleSimulation(variableIndex, troopId, battleCount, seed);
+        return false;
+    }
+    // END OF BATTLE SIMULATION SECTION
+
+    // EXPRESSION SECTION
+    // This section contains commands which combine several pieces of data in one step. See the
+    // EXPRESSION EVALUATOR notes above for what an expression may contain.
+
+    if( 0 == strcmp( cmd, "dyndataaccess_eval" ) )
+    {   // Evaluate an integer expression and store the result
+        // The expression is compiled the first time the comment line runs and reused afterwards
+        // Parameter 0: The index of the RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The expression, for example "enemy[2].defense * 2 - party[1].attack"
+        const EvalProgram* program = evalProgramFor(parsedData->parameters[1].text, eventId, pageId, lineId);
+        // Store the data in the appropriate RM2K3 variable
+        if(program != NULL)
+            RPG::variables[variableIndex] = evalRun(program->code);
+        return false;
+    }
+    // END OF EXPRESSION SECTION
+
     // ITEM DATA SECTION
 
     // Contributed by DJC
 
-    if( 0 == cmd.compare( "dyndataaccess_get_item_attribute" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_item_attribute" ) )
     {   // Get whether an item has requested attribute tagged
         // Parameter 0: The index of the RM2K3 variable to store data in (0=false, 1=true)
         variableIndex = (int) parsedData->parameters[0].number;
@@ -405,7 +2237,7 @@ bool onComment( const char* text,
 
     // Contributed by Aubrey the Bard
 
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_database_id" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_database_id" ) )
     {   // Get the database ID for an enemy
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -421,7 +2253,7 @@ bool onComment( const char* text,
     // different type of enemy. Function calls of that sort are beyond the scope of this project,
     // but the DynBattlerChange plugin (https://rpgmaker.net/engines/rt2k3/utilities/97/) handles
     // transforming enemies.
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_current_hp" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_current_hp" ) )
     {   // Get the current HP for an enemy
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -431,7 +2263,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::monsters[partyIndex]->hp;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_enemy_current_hp" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_enemy_current_hp" ) )
     {   // Set the current HP for an enemy
         // Parameter 0: The value to set data to
         dataValue = (int) parsedData->parameters[0].number;
@@ -441,7 +2273,7 @@ bool onComment( const char* text,
         RPG::monsters[partyIndex]->hp = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_current_mp" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_current_mp" ) )
     {   // Get the current MP for an enemy
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -451,7 +2283,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::monsters[partyIndex]->mp;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_enemy_current_mp" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_enemy_current_mp" ) )
     {   // Set the current MP for an enemy
         // Parameter 0: The value to set data to
         dataValue = (int) parsedData->parameters[0].number;
@@ -465,7 +2297,7 @@ bool onComment( const char* text,
     // enemies; they are held in the DBMonster objects, which store data about each type of
     // enemy. Thus, the remainder of individual enemy attributes only have get comment commands,
     // not set comment commands.
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_max_hp" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_max_hp" ) )
     {   // Get the maximum HP for an enemy
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -475,7 +2307,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::monsters[partyIndex]->getMaxHp();
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_max_mp" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_max_mp" ) )
     {   // Get the maximum MP for an enemy
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -485,7 +2317,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::monsters[partyIndex]->getMaxMp();
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_attack" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_attack" ) )
     {   // Get the Attack for an enemy
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -495,7 +2327,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::monsters[partyIndex]->getAttack();
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_defense" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_defense" ) )
     {   // Get the Defense for an enemy
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -505,7 +2337,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::monsters[partyIndex]->getDefense();
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_intelligence" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_intelligence" ) )
     {   // Get the Intelligence for a enemy
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -515,7 +2347,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::monsters[partyIndex]->getIntelligence();
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_agility" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_agility" ) )
     {   // Get the Agility for an enemy
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -525,7 +2357,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::monsters[partyIndex]->getAgility();
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_all_stats" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_all_stats" ) )
     {   // Get all the stats for an enemy
         // Parameter 0: The index of the first RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -554,7 +2386,7 @@ bool onComment( const char* text,
 
     //Contributed by DJC
 
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_database_stats" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_database_stats" ) )
     {   // Gets the unaltered database attack, defense, intelligence, and agility of requested monster
         // Parameter 0: The index of the first of four sequential RM2K3 variables to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -570,7 +2402,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::dbMonsters[RPG::monsters[partyIndex]->databaseId]->agility;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_enemy_attack" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_enemy_attack" ) )
     {   // Change the enemy's current attack relative to the database default
         // Parameter 0: The value to set data to
         dataValue = (int) parsedData->parameters[0].number;
@@ -580,7 +2412,7 @@ bool onComment( const char* text,
         RPG::monsters[partyIndex]->attackDiff = dataValue - RPG::dbMonsters[RPG::monsters[partyIndex]->databaseId]->attack;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_enemy_defense" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_enemy_defense" ) )
     {   // Change the enemy's current attack relative to the database default
         // Parameter 0: The value to set data to
         dataValue = (int) parsedData->parameters[0].number;
@@ -590,7 +2422,7 @@ bool onComment( const char* text,
         RPG::monsters[partyIndex]->defenseDiff = dataValue - RPG::dbMonsters[RPG::monsters[partyIndex]->databaseId]->defense;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_enemy_intelligence" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_enemy_intelligence" ) )
     {   // Change the enemy's current attack relative to the database default
         // Parameter 0: The value to set data to
         dataValue = (int) parsedData->parameters[0].number;
@@ -600,7 +2432,7 @@ bool onComment( const char* text,
         RPG::monsters[partyIndex]->intelligenceDiff = dataValue - RPG::dbMonsters[RPG::monsters[partyIndex]->databaseId]->intelligence;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_enemy_agility" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_enemy_agility" ) )
     {   // Change the enemy's current attack relative to the database default
         // Parameter 0: The value to set data to
         dataValue = (int) parsedData->parameters[0].number;
@@ -610,7 +2442,7 @@ bool onComment( const char* text,
         RPG::monsters[partyIndex]->agilityDiff = dataValue - RPG::dbMonsters[RPG::monsters[partyIndex]->databaseId]->agility;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_attribute_resistance" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_attribute_resistance" ) )
     {   // Get database default enemy attribute resistance percentage
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -631,7 +2463,7 @@ bool onComment( const char* text,
             RPG::variables[variableIndex] = RPG::attributes[attributeIndex]->dmgE;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_condition_resistance" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_condition_resistance" ) )
     {   // Get database default enemy condition resistance percentage
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -652,7 +2484,7 @@ bool onComment( const char* text,
             RPG::variables[variableIndex] = RPG::conditions[conditionIndex]->susE;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_force_enemy_condition" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_force_enemy_condition" ) )
     {   // Forces an enemy to suffer a condition
         // Failure if resistance less than or equal to specified level
         // Does not function correctly for condition 0 (KO); inflicts condition, but enemy does not KO; requires additional scripting
@@ -668,7 +2500,7 @@ bool onComment( const char* text,
             if(conditionIndex == 1) RPG::monsters[partyIndex]->hp = 0; } // Reduce HP to zero if Fallen condition
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_atb" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_atb" ) )
     {   // Get the current ATB for an enemy (30000 full)
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -678,7 +2510,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::monsters[partyIndex]->atbValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_enemy_atb" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_enemy_atb" ) )
     {   // Set the current ATB for an enemy (300000 full, needs extra power of ten)
         // Parameter 0: The value to set data to
         dataValue = (int) parsedData->parameters[0].number;
@@ -688,17 +2520,17 @@ bool onComment( const char* text,
         RPG::monsters[partyIndex]->atbValue = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_enemy_text_popup" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_enemy_text_popup" ) )
     {   // Display pop-up text for an enemy
         // Parameter 0: Text to display, limited characters
-        textString = parsedData->parameters[0].text;
+        textString = &internText(parsedData->parameters[0].text);
         // Parameter 1: The party index of the enemy to get data from
         partyIndex = (int) parsedData->parameters[1].number - 1;
         // Show the text
-        RPG::monsters[partyIndex]->damagePopup(textString);
+        RPG::monsters[partyIndex]->damagePopup(*textString);
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_enemy_number_popup" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_enemy_number_popup" ) )
     {   // Display pop-up number for an enemy
         // Parameter 0: Number to display
         dataValue = (int) parsedData->parameters[0].number;
@@ -710,7 +2542,7 @@ bool onComment( const char* text,
         RPG::monsters[partyIndex]->damagePopup(dataValue, dataColor);
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_enemy_flash" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_enemy_flash" ) )
     {   // Flash target enemy a specific RGB intensity for a number of frames
         // Parameter 0: The party index of the enemy
         partyIndex = (int) parsedData->parameters[0].number - 1;
@@ -728,17 +2560,93 @@ bool onComment( const char* text,
         RPG::monsters[partyIndex]->flash(redLevel, greenLevel, blueLevel, intensityLevel, flashFrames);
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_enemy_sprite" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_queue_enemy_text_popup" ) )
+    {   // Schedule pop-up text for a set of enemies, optionally repeated
+        // Parameter 0: Text to display, limited characters
+        textString = &internText(parsedData->parameters[0].text);
+        // Parameter 1: The set of enemies (add 1 for enemy 1, 2 for enemy 2, 4 for enemy 3, ... 128 for enemy 8)
+        int targets = (int) parsedData->parameters[1].number;
+        // Parameter 2: Number of frames to wait before the first popup
+        int delay = (int) parsedData->parameters[2].number;
+        // Parameter 3 (optional): Number of times to show the popup, 1 if omitted
+        int repeats = optionalParameter(parsedData, 3, 1);
+        // Parameter 4 (optional): Number of frames between repetitions, 0 if omitted
+        int interval = optionalParameter(parsedData, 4, 0);
+        // Schedule the popups
+        ScheduledEffect effect = ScheduledEffect();
+        effect.type = EFFECT_TEXT_POPUP;
+        effect.targets = targets;
+        effect.text = textString;
+        scheduleEffect(effect, delay, repeats, interval);
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_queue_enemy_number_popup" ) )
+    {   // Schedule a pop-up number for a set of enemies, optionally repeated
+        // Parameter 0: Number to display
+        dataValue = (int) parsedData->parameters[0].number;
+        // Parameter 1: The set of enemies (add 1 for enemy 1, 2 for enemy 2, 4 for enemy 3, ... 128 for enemy 8)
+        int targets = (int) parsedData->parameters[1].number;
+        // Parameter 2: Number color (0-19)
+        int dataColor = (int) parsedData->parameters[2].number;
+        // Parameter 3: Number of frames to wait before the first popup
+        int delay = (int) parsedData->parameters[3].number;
+        // Parameter 4 (optional): Number of times to show the popup, 1 if omitted
+        int repeats = optionalParameter(parsedData, 4, 1);
+        // Parameter 5 (optional): Number of frames between repetitions, 0 if omitted
+        int interval = optionalParameter(parsedData, 5, 0);
+        // Schedule the popups
+        ScheduledEffect effect = ScheduledEffect();
+        effect.type = EFFECT_NUMBER_POPUP;
+        effect.targets = targets;
+        effect.values[0] = dataValue;
+        effect.values[1] = dataColor;
+        scheduleEffect(effect, delay, repeats, interval);
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_queue_enemy_flash" ) )
+    {   // Schedule a flash of a set of enemies, optionally repeated
+        // Parameter 0: The set of enemies (add 1 for enemy 1, 2 for enemy 2, 4 for enemy 3, ... 128 for enemy 8)
+        int targets = (int) parsedData->parameters[0].number;
+        // Parameters 1-5: Red value, green value, blue value, intensity value, number of frames
+        ScheduledEffect effect = ScheduledEffect();
+        effect.type = EFFECT_FLASH;
+        effect.targets = targets;
+        for(int i=0; i<5; i++)
+            effect.values[i] = (int) parsedData->parameters[i+1].number;
+        // Parameter 6: Number of frames to wait before the first flash
+        int delay = (int) parsedData->parameters[6].number;
+        // Parameter 7 (optional): Number of times to flash, 1 if omitted
+        int repeats = optionalParameter(parsedData, 7, 1);
+        // Parameter 8 (optional): Number of frames between repetitions, 0 if omitted
+        int interval = optionalParameter(parsedData, 8, 0);
+        // Schedule the flashes
+        scheduleEffect(effect, delay, repeats, interval);
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_clear_effect_queue" ) )
+    {   // Cancel all scheduled popups and flashes
+        effectQueueCount = 0;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_effect_queue_size" ) )
+    {   // Get the number of scheduled popups and flashes still waiting to be shown
+        // Parameter 0: The index of the RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Store the data in the appropriate RM2K3 variable
+        RPG::variables[variableIndex] = effectQueueCount;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_set_enemy_sprite" ) )
     {   // Set the enemy graphic
         // Parameter 0: Filename of enemy graphic, including directory relative to game folder
-        textString = parsedData->parameters[0].text;
+        textString = &internText(parsedData->parameters[0].text);
         // Parameter 1: The party index of the enemy
         partyIndex = (int) parsedData->parameters[1].number - 1;
         // Change the battler image
-        RPG::monsters[partyIndex]->image->loadFromFile(textString);
+        RPG::monsters[partyIndex]->image->loadFromFile(*textString);
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_defeated_count" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_defeated_count" ) )
     {   // Gets the number of defeated foes in the current battle.
         // Parameter 0: The index of the RM2K3 variable to store data
         variableIndex = (int) parsedData->parameters[0].number;
@@ -748,7 +2656,7 @@ bool onComment( const char* text,
                 RPG::variables[variableIndex]++; }
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_undefeated_count" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_undefeated_count" ) )
     {   // Gets the number of undefeated foes in the current battle.
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -762,7 +2670,7 @@ bool onComment( const char* text,
     }
 
     //Contributed by xshobux
-    if( 0 == cmd.compare( "dyndataaccess_get_enemy_condition_turns" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_enemy_condition_turns" ) )
     {   // Get the number of turns an enemy has been afflicted with the requested condition
         // 0=not currently afflicted with requested condition
         // Parameter 0: The index of the RM2K3 variable to store data in
@@ -781,7 +2689,7 @@ bool onComment( const char* text,
 
     // Contributed by DJC
 
-    if( 0 == cmd.compare( "dyndataaccess_get_encounter_rate_current" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_encounter_rate_current" ) )
     {   // Get current map encounter rate
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -789,7 +2697,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::map->encounterRateNew;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_encounter_rate_current" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_encounter_rate_current" ) )
     {   // Set current map encounter rate
         // Parameter 0: The data value to change the map encounter rate to
         dataValue = (int) parsedData->parameters[0].number;
@@ -797,12 +2705,154 @@ bool onComment( const char* text,
         RPG::map->encounterRateNew = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_get_database_encounter_rate" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_database_encounter_rate" ) )
     {   // Get database default map encounter rate
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
         // Store the data in the specified variable
-        RPG::variables[variableIndex] = RPG::mapTree->properties[RPG::mapTree->getTreeIndex(RPG::map->properties->id)]->encounterRate;
+        updateMapCache();
+        RPG::variables[variableIndex] = currentMapTreeProperties->encounterRate;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_database_encounter_rate_map" ) )
+    {   // Get database default encounter rate of any map
+        // Variable is set to -1 if there is no map with this ID
+        // Parameter 0: The index of the RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The ID of the map
+        int mapId = (int) parsedData->parameters[1].number;
+        // Store the data in the specified variable
+        int treeIndex = (mapId > 0) ? getCachedTreeIndex(mapId) : -1;
+        if(treeIndex < 0 || treeIndex >= RPG::mapTree->properties.count())
+            RPG::variables[variableIndex] = -1;
+        else
+            RPG::variables[variableIndex] = RPG::mapTree->properties[treeIndex]->encounterRate;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_set_encounter_rate_override" ) )
+    {   // Set an encounter rate which is applied every time a map is loaded
+        // Persistent change, stored in the savegame
+        // Parameter 0: The data value to change the map encounter rate to
+        dataValue = (int) parsedData->parameters[0].number;
+        // Parameter 1: The ID of the map
+        int mapId = (int) parsedData->parameters[1].number;
+        // Store the override, and apply it right away if it is for the current map
+        encounterRateOverrides[mapId] = dataValue;
+        updateMapCache();
+        if(mapId == currentMapId)
+            RPG::map->encounterRateNew = dataValue;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_encounter_rate_override" ) )
+    {   // Get the encounter rate override of a map
+        // Variable is set to -1 if the map has no override
+        // Parameter 0: The index of the RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The ID of the map
+        int mapId = (int) parsedData->parameters[1].number;
+        // Store the data in the specified variable
+        std::map<int, int>::iterator found = encounterRateOverrides.find(mapId);
+        RPG::variables[variableIndex] = (found != encounterRateOverrides.end()) ? found->second : -1;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_clear_encounter_rate_override" ) )
+    {   // Remove the encounter rate override of a map (0 for all maps)
+        // The current map returns to its database encounter rate only if it had an override, so a
+        // rate set with dyndataaccess_set_encounter_rate_current is left alone otherwise
+        // Parameter 0: The ID of the map
+        int mapId = (int) parsedData->parameters[0].number;
+        // Remove the override(s)
+        updateMapCache();
+        bool currentRemoved = encounterRateOverrides.count(currentMapId) > 0 && (mapId == 0 || mapId == currentMapId);
+        if(mapId == 0)
+            encounterRateOverrides.clear();
+        else
+            encounterRateOverrides.erase(mapId);
+        if(currentRemoved && currentMapTreeProperties != NULL)
+            RPG::map->encounterRateNew = currentMapTreeProperties->encounterRate;
+        return false;
+    }
+
+    // Map event proximity queries; see EVENT SPATIAL INDEX above
+
+    if( 0 == strcmp( cmd, "dyndataaccess_find_nearest_event" ) )
+    {   // Find the map event nearest to a map tile
+        // Stores the event ID (0 if none within range) and its distance in tiles, rounded down, in two sequential variables
+        // Parameter 0: The index of the first of two sequential RM2K3 variables to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameters 1-2: The X and Y coordinates of the tile to search from
+        int x = (int) parsedData->parameters[1].number;
+        int y = (int) parsedData->parameters[2].number;
+        // Parameter 3: The maximum distance to search in tiles
+        int maxRadius = (int) parsedData->parameters[3].number;
+        // Parameter 4 (optional): The ID of an event to leave out, such as the one asking; 0 if omitted
+        int ignoreId = optionalParameter(parsedData, 4, 0);
+        // Store the data in the appropriate RM2K3 variables
+        updateEventIndex();
+        clampMapSearch(x, y, maxRadius);
+        int nearest = findNearestEvent(x, y, maxRadius, ignoreId);
+        int nearestId = 0, distance = 0;
+        if(nearest >= 0) {
+            const IndexedEvent& event = indexedEvents[nearest];
+            int squared = (event.x - x) * (event.x - x) + (event.y - y) * (event.y - y);
+            while((distance + 1) * (distance + 1) <= squared)
+                distance++;
+            nearestId = event.id; }
+        RPG::variables[variableIndex] = nearestId;
+        RPG::variables[variableIndex+1] = distance;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_events_in_radius" ) ||
+        0 == strcmp( cmd, "dyndataaccess_get_events_in_rect" ) )
+    {   // Get the map events within a distance of a tile (nearest first) or in a rectangle (by ID)
+        // Stores the number of events found, then the ID of each, in sequential variables
+        // Parameter 0: The index of the first RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The maximum number of event IDs to store
+        int maxCount = (int) parsedData->parameters[1].number;
+        // Parameters 2-4 (radius): The X and Y coordinates of the center tile and the radius in tiles
+        // Parameters 2-5 (rectangle): The X and Y coordinates of two opposite corners
+        int x1 = (int) parsedData->parameters[2].number;
+        int y1 = (int) parsedData->parameters[3].number;
+        int centerX = x1, centerY = y1, radius = -1;
+        int x2, y2;
+        if(0 == strcmp( cmd, "dyndataaccess_get_events_in_radius" )) {
+            radius = (int) parsedData->parameters[4].number;
+            clampMapSearch(centerX, centerY, radius);
+            x2 = centerX + radius;
+            y2 = centerY + radius;
+            x1 = centerX - radius;
+            y1 = centerY - radius; }
+        else {
+            x2 = (int) parsedData->parameters[4].number;
+            y2 = (int) parsedData->parameters[5].number; }
+        // Store the data in the appropriate RM2K3 variables
+        static std::vector<int> found;
+        updateEventIndex();
+        findEvents(x1, y1, x2, y2, centerX, centerY, radius, found);
+        int count = ((int) found.size() < maxCount) ? (int) found.size() : maxCount;
+        RPG::variables[variableIndex] = count;
+        for(int i=0; i<count; i++)
+            RPG::variables[variableIndex+1+i] = found[i];
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_line_of_sight" ) )
+    {   // Get whether the straight line of tiles between two tiles is free of a blocking terrain
+        // The two end tiles themselves are not checked
+        // Parameter 0: The index of the RM2K3 variable to store data in (0=blocked, 1=clear)
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameters 1-4: The X and Y coordinates of the two tiles
+        int x1 = (int) parsedData->parameters[1].number;
+        int y1 = (int) parsedData->parameters[2].number;
+        int x2 = (int) parsedData->parameters[3].number;
+        int y2 = (int) parsedData->parameters[4].number;
+        // Parameter 5: The terrain database ID which blocks sight
+        terrainIndex = (int) parsedData->parameters[5].number;
+        // Store the data in the appropriate RM2K3 variable
+        updateTerrainGrid();
+        clampMapPoint(x1, y1);              // Keeps the trace short and its error term from overflowing
+        clampMapPoint(x2, y2);
+        RPG::variables[variableIndex] = hasLineOfSight(x1, y1, x2, y2, terrainIndex) ? 1 : 0;
         return false;
     }
     // END OF MAP DATA SECTION
@@ -811,7 +2861,7 @@ bool onComment( const char* text,
 
     // Contributed by DJC
 
-    if( 0 == cmd.compare( "dyndataaccess_get_skill_cost" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_get_skill_cost" ) )
     {   // Get the cost of a skill
         // Parameter 0: The index of the RM2K3 variable to store data in
         variableIndex = (int) parsedData->parameters[0].number;
@@ -821,7 +2871,7 @@ bool onComment( const char* text,
         RPG::variables[variableIndex] = RPG::skills[skillIndex]->mpCost;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_skill_cost" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_skill_cost" ) )
     {   // Set skill cost
         // This will overwrite database values, but volatile, resets on reload
         // Parameter 0: The data value to change skill cost to
@@ -832,7 +2882,7 @@ bool onComment( const char* text,
         RPG::skills[skillIndex]->mpCost = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_skill_attack_influence" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_skill_attack_influence" ) )
     {   // Sets a skill's attack influence
         // This will overwrite database values, but volatile, resets on reload
         // Parameter 0: The data value to change skill cost to
@@ -843,7 +2893,7 @@ bool onComment( const char* text,
         RPG::skills[skillIndex]->atkInfluence = dataValue;
         return false;
     }
-    if( 0 == cmd.compare( "dyndataaccess_set_skill_effect_rating" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_skill_effect_rating" ) )
     {   // Sets a skill's effect rating (damage or healing)
         // This will overwrite database values, but volatile, resets on reload
         // Parameter 0: The data value to change skill cost to
@@ -860,7 +2910,7 @@ bool onComment( const char* text,
 
     // Contributed by DJC
 
-    if( 0 == cmd.compare( "dyndataaccess_set_terrain_initiative_rate" ) )
+    if( 0 == strcmp( cmd, "dyndataaccess_set_terrain_initiative_rate" ) )
     {   // Set terrain's initiative encounter rate (as a percentage)
         // Parameter 0: The data value to change the rate to
         dataValue = (int) parsedData->parameters[0].number;
@@ -872,8 +2922,163 @@ bool onComment( const char* text,
     }
     //!do the other terrain type battles, and one that cycles through all terrains
     //!maybe some for passability so you don't need to change tilesets workaround
+
+    // Terrain map queries; see TERRAIN GRID above
+
+    if( 0 == strcmp( cmd, "dyndataaccess_get_terrain_id" ) )
+    {   // Get the terrain ID of a map tile (0 if off the map)
+        // Parameter 0: The index of the RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameters 1-2: The X and Y coordinates of the tile
+        int x = (int) parsedData->parameters[1].number;
+        int y = (int) parsedData->parameters[2].number;
+        // Store the data in the appropriate RM2K3 variable
+        updateTerrainGrid();
+        RPG::variables[variableIndex] = terrainAt(x, y);
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_get_hero_terrain_id" ) )
+    {   // Get the terrain ID of the tile the hero stands on
+        // Parameter 0: The index of the RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Store the data in the appropriate RM2K3 variable
+        updateTerrainGrid();
+        RPG::variables[variableIndex] = terrainAt(RPG::hero->x, RPG::hero->y);
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_count_terrain_in_rect" ) )
+    {   // Count the tiles of a terrain in a rectangle of the map, corners included
+        // Parameter 0: The index of the RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The terrain database ID
+        terrainIndex = (int) parsedData->parameters[1].number;
+        // Parameters 2-5: The X and Y coordinates of two opposite corners
+        int x1 = (int) parsedData->parameters[2].number;
+        int y1 = (int) parsedData->parameters[3].number;
+        int x2 = (int) parsedData->parameters[4].number;
+        int y2 = (int) parsedData->parameters[5].number;
+        // Store the data in the appropriate RM2K3 variable
+        updateTerrainGrid();
+        RPG::variables[variableIndex] = countTerrainInRect(terrainIndex, x1, y1, x2, y2);
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_count_terrain_in_radius" ) )
+    {   // Count the tiles of a terrain within a distance of a map tile, center included
+        // Parameter 0: The index of the RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The terrain database ID
+        terrainIndex = (int) parsedData->parameters[1].number;
+        // Parameters 2-3: The X and Y coordinates of the center tile
+        int x = (int) parsedData->parameters[2].number;
+        int y = (int) parsedData->parameters[3].number;
+        // Parameter 4: The radius in tiles
+        int radius = (int) parsedData->parameters[4].number;
+        // Store the data in the appropriate RM2K3 variable
+        updateTerrainGrid();
+        clampMapSearch(x, y, radius);
+        RPG::variables[variableIndex] = countTerrainInRadius(terrainIndex, x, y, radius);
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_locate_terrain_in_rect" ) ||
+        0 == strcmp( cmd, "dyndataaccess_locate_terrain_in_radius" ) )
+    {   // Store the positions of tiles of a terrain in a rectangle or within a distance of a tile
+        // Stores the number of tiles found, then the X and Y coordinates of each, in sequential variables
+        // Parameter 0: The index of the first RM2K3 variable to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The maximum number of positions to store
+        int maxCount = (int) parsedData->parameters[1].number;
+        // Parameter 2: The terrain database ID
+        terrainIndex = (int) parsedData->parameters[2].number;
+        // Parameters 3-6 (rectangle): The X and Y coordinates of two opposite corners
+        // Parameters 3-5 (radius): The X and Y coordinates of the center tile and the radius in tiles
+        int x1 = (int) parsedData->parameters[3].number;
+        int y1 = (int) parsedData->parameters[4].number;
+        int centerX = x1, centerY = y1, radius = -1;
+        int x2, y2;
+        if(0 == strcmp( cmd, "dyndataaccess_locate_terrain_in_radius" )) {
+            radius = (int) parsedData->parameters[5].number;
+            clampMapSearch(centerX, centerY, radius);
+            x2 = centerX + radius;
+            y2 = centerY + radius;
+            x1 = centerX - radius;
+            y1 = centerY - radius; }
+        else {
+            x2 = (int) parsedData->parameters[5].number;
+            y2 = (int) parsedData->parameters[6].number; }
+        // Store the data in the appropriate RM2K3 variables
+        static std::vector<int> positions;
+        updateTerrainGrid();
+        if(maxCount > terrainGridWidth * terrainGridHeight)
+            maxCount = terrainGridWidth * terrainGridHeight;   // No query can find more tiles than the map has
+        positions.resize(maxCount > 0 ? maxCount * 2 : 1);
+        int found = locateTerrain(terrainIndex, x1, y1, x2, y2, centerX, centerY, radius, &positions[0], maxCount);
+        RPG::variables[variableIndex] = found;
+        for(int i=0; i<found*2; i++)
+            RPG::variables[variableIndex+1+i] = positions[i];
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_find_nearest_terrain" ) )
+    {   // Find the nearest tile of a terrain to a map tile
+        // Stores the X and Y coordinates in two sequential variables, both -1 if none within range
+        // Parameter 0: The index of the first of two sequential RM2K3 variables to store data in
+        variableIndex = (int) parsedData->parameters[0].number;
+        // Parameter 1: The terrain database ID
+        terrainIndex = (int) parsedData->parameters[1].number;
+        // Parameters 2-3: The X and Y coordinates of the tile to search from
+        int x = (int) parsedData->parameters[2].number;
+        int y = (int) parsedData->parameters[3].number;
+        // Parameter 4: The maximum distance to search in tiles
+        int maxRadius = (int) parsedData->parameters[4].number;
+        // Store the data in the appropriate RM2K3 variables
+        updateTerrainGrid();
+        clampMapSearch(x, y, maxRadius);
+        int foundX = -1, foundY = -1;
+        if(!findNearestTerrain(terrainIndex, x, y, maxRadius, foundX, foundY))
+            foundX = foundY = -1;
+        RPG::variables[variableIndex] = foundX;
+        RPG::variables[variableIndex+1] = foundY;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_refresh_terrain_cache" ) )
+    {   // Read the terrain of the current map again after tiles were changed by events
+        // (Change Tileset, tile substitution); map changes are noticed automatically
+        invalidateTerrainGrid();
+        return false;
+    }
     // END OF TERRAIN DATA SECTION
 
+    // DIAGNOSTICS SECTION
+    // This section contains commands for measuring the plugin and auditing game data in bulk rather
+    // than accessing individual pieces of data.
+
+    if( 0 == strcmp( cmd, "dyndataaccess_export_database" ) )
+    {   // Write the runtime values of skills, items, monsters, actors, conditions and terrains to a file
+        // See DATABASE EXPORT above for the file format
+        // Parameter 0: The filename to write to, relative to the main game folder
+        // Parameter 1 (optional): 1 to also write one CSV file per table, 0 if omitted
+        int csv = optionalParameter(parsedData, 1, 0);
+        // Parameter 2 (optional): The index of an RM2K3 variable to store success in (0=failed, 1=written)
+        variableIndex = optionalParameter(parsedData, 2, 0);
+        // Write the export
+        bool written = exportDatabase(parsedData->parameters[0].text, csv != 0);
+        if(variableIndex > 0)
+            RPG::variables[variableIndex] = written ? 1 : 0;
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_trace_start" ) )
+    {   // Start recording a timeline of handled comment commands, replacing any trace in progress
+        // Parameter 0: The filename to write the trace to, relative to the main game folder
+        // Start the trace
+        traceBegin(parsedData->parameters[0].text);
+        return false;
+    }
+    if( 0 == strcmp( cmd, "dyndataaccess_trace_stop" ) )
+    {   // Stop recording the timeline and write it to its file as Chrome trace-event JSON
+        traceEnd();
+        return false;
+    }
+    // END OF DIAGNOSTICS SECTION
+
     // ATTRIBUTE DATA SECTION
 
     // END OF COMMENT COMMANDS
@@ -881,3 +3086,37 @@ bool onComment( const char* text,
     // No comment commands for this plugin detected; pass notification on for other plugins
     return true;
 }
+
+//! Hand comments to handleCommentCommand, timing them while the tracer is running
+/*!
+    onComment() is called when the game runs across a comment line in its event scripting. New
+    comment commands belong in handleCommentCommand(), not here.
+
+    \param text (const char*) The comment's content as simple text
+    \param parsedData (const RPG::ParsedCommentData*) The already parsed data
+    \param nextScriptLine (RPG::EventScriptLine*) The next event script line after the comment
+    \param scriptData (RPG::EventScriptData*) Pointer to the RPG::EventScriptData object of the current event script
+    \param eventId (int) The ID of the current event (negative for common events, zero for battle events)
+    \param pageId (int) The ID of the current event page (zero for common and battle events - sorry, no battle event page ID yet)
+    \param lineId (int) The zero-based line number
+    \param nextLineId (int*) Pointer to the next executed line number (-1 for default)
+    \return (bool) false will prevent other plugins from receiving this notification, use true otherwise
+*/
+bool onComment( const char* text,
+                const RPG::ParsedCommentData* 	parsedData,
+                RPG::EventScriptLine* 	nextScriptLine,
+                RPG::EventScriptData* 	scriptData,
+                int 	eventId,
+                int 	pageId,
+                int 	lineId,
+                int* 	nextLineId )
+{
+    if(!traceEnabled)
+        return handleCommentCommand(text, parsedData, nextScriptLine, scriptData, eventId, pageId, lineId, nextLineId);
+    long long start = traceTimestamp();
+    bool passOn = handleCommentCommand(text, parsedData, nextScriptLine, scriptData, eventId, pageId, lineId, nextLineId);
+    // Leave out a command which stopped the trace or started a new one, as it belongs to neither
+    if(!passOn && traceEnabled && start >= traceStart)
+        traceRecordComment(parsedData->command, eventId, pageId, lineId, start, traceTimestamp());
+    return passOn;
+}
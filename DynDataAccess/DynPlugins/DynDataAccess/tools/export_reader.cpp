@@ -0,0 +1,178 @@
+/*! \file export_reader.cpp
+
+    \brief Reader for DynDataAccess database exports
+
+    \author Bernard J. Badger, AKA Aubrey the Bard
+
+    A small stand-alone program for reading the files written by @dyndataaccess_export_database
+    outside of the game, for example on a Linux machine used for balance analysis. It does not
+    depend on DynRPG. Build it with any C++ compiler:
+
+        g++ -O2 -o export_reader export_reader.cpp
+
+    Usage:
+
+        export_reader <export file>                 Lists the tables and their columns
+        export_reader <export file> <table>         Prints a table as CSV
+        export_reader <export file> <table> <column> Prints count, sum, min, max and mean of a column
+
+    The file format is described in the DATABASE EXPORT section of DynDataAccess.cpp.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//! One table of an export file; values are stored column after column
+struct ExportTable
+{
+    std::string name;
+    int rows;
+    std::vector<std::string> columnNames;
+    std::vector<int> values;
+
+    //! Get the values of one column, or NULL if the table has no such column
+    const int* column(const std::string& columnName) const
+    {
+        for(size_t c=0; c<columnNames.size(); c++) {
+            if(columnNames[c] == columnName)
+                return rows ? &values[c * rows] : NULL; }
+        return NULL;
+    }
+};
+
+//! Reads the little-endian 32-bit integers and strings an export file is made of
+class ExportFile
+{
+public:
+    ExportFile(FILE* file) : file(file), ok(true) {}
+
+    int readInt()
+    {
+        unsigned char bytes[4];
+        if(fread(bytes, 1, 4, file) != 4) {
+            ok = false;
+            return 0; }
+        return (int) (bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int) bytes[3] << 24));
+    }
+    std::string readString()
+    {
+        int length = readInt();
+        if(length < 0 || length > 4096) {
+            ok = false;
+            return ""; }
+        std::string text(length, '\0');
+        if(length > 0 && fread(&text[0], 1, length, file) != (size_t) length)
+            ok = false;
+        return text;
+    }
+
+    FILE* file;
+    bool ok;
+};
+
+//! Load every table of an export file; returns false if the file is not a valid export
+bool loadExport(const char* filename, std::vector<ExportTable>& tables)
+{
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return false; }
+    ExportFile reader(file);
+    char magic[4];
+    if(fread(magic, 1, 4, file) != 4 || memcmp(magic, "DDAX", 4) != 0) {
+        fprintf(stderr, "%s is not a DynDataAccess export\n", filename);
+        fclose(file);
+        return false; }
+    int version = reader.readInt();
+    if(version != 1) {
+        fprintf(stderr, "%s has unsupported version %d\n", filename, version);
+        fclose(file);
+        return false; }
+    int tableCount = reader.readInt();
+    for(int t=0; reader.ok && t<tableCount; t++)
+    {
+        tables.push_back(ExportTable());
+        ExportTable& table = tables.back();
+        table.name = reader.readString();
+        table.rows = reader.readInt();
+        int columnCount = reader.readInt();
+        if(table.rows < 0 || columnCount < 0) {
+            reader.ok = false;
+            break; }
+        for(int c=0; reader.ok && c<columnCount; c++)
+            table.columnNames.push_back(reader.readString());
+        table.values.resize((size_t) table.rows * columnCount);
+        for(size_t i=0; reader.ok && i<table.values.size(); i++)
+            table.values[i] = reader.readInt();
+    }
+    fclose(file);
+    if(!reader.ok)
+        fprintf(stderr, "%s is truncated or damaged\n", filename);
+    return reader.ok;
+}
+
+//! Find a table by name, or NULL if there is none
+const ExportTable* findTable(const std::vector<ExportTable>& tables, const char* name)
+{
+    for(size_t t=0; t<tables.size(); t++) {
+        if(tables[t].name == name)
+            return &tables[t]; }
+    fprintf(stderr, "No table named %s\n", name);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2 || argc > 4) {
+        fprintf(stderr, "Usage: %s <export file> [<table> [<column>]]\n", argv[0]);
+        return 2; }
+    std::vector<ExportTable> tables;
+    if(!loadExport(argv[1], tables))
+        return 1;
+
+    if(argc == 2)
+    {   // List the tables and their columns
+        for(size_t t=0; t<tables.size(); t++) {
+            printf("%s (%d rows):", tables[t].name.c_str(), tables[t].rows);
+            for(size_t c=0; c<tables[t].columnNames.size(); c++)
+                printf(" %s", tables[t].columnNames[c].c_str());
+            printf("\n"); }
+        return 0;
+    }
+
+    const ExportTable* table = findTable(tables, argv[2]);
+    if(table == NULL)
+        return 1;
+
+    if(argc == 3)
+    {   // Print the table as CSV, one row per database ID
+        printf("id");
+        for(size_t c=0; c<table->columnNames.size(); c++)
+            printf(",%s", table->columnNames[c].c_str());
+        printf("\n");
+        for(int i=0; i<table->rows; i++) {
+            printf("%d", i + 1);
+            for(size_t c=0; c<table->columnNames.size(); c++)
+                printf(",%d", table->values[c * table->rows + i]);
+            printf("\n"); }
+        return 0;
+    }
+
+    // Summarize one column
+    const int* column = table->column(argv[3]);
+    if(column == NULL) {
+        fprintf(stderr, "Table %s has no rows or no column named %s\n", argv[2], argv[3]);
+        return 1; }
+    long long sum = 0;
+    int lowest = column[0], highest = column[0];
+    for(int i=0; i<table->rows; i++) {
+        sum += column[i];
+        if(column[i] < lowest)
+            lowest = column[i];
+        if(column[i] > highest)
+            highest = column[i]; }
+    printf("count %d\nsum %lld\nmin %d\nmax %d\nmean %.3f\n", table->rows, sum, lowest, highest, (double) sum / table->rows);
+    return 0;
+}